@@ -0,0 +1,110 @@
+// Round trip latency of yos::shm_channel against socket + dump()/parse().
+// Build: c++ -std=c++14 -O2 -I<nlohmann/json include> benchshm.cc -lrt
+// Usage: benchshm [roundtrips]
+// Polling loops yield so that it also runs on a single core.
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include "jsonutil_shm.hh"
+
+struct Point {
+  double x, y, z;
+  int    id;
+  JSON_MEMBER_ARRAY(x, y, z, id);
+};
+
+struct Triangle {
+  Point       p1, p2, p3;
+  std::string name;
+  JSON_MEMBER_ARRAY(p1, p2, p3, name);
+};
+
+int N = 100000;
+
+double shm_roundtrip() {
+  auto ping = yos::shm_channel<Triangle>::create("/benchshm_ping");
+  auto pong = yos::shm_channel<Triangle>::create("/benchshm_pong");
+  auto rx   = yos::shm_channel<Triangle>::open("/benchshm_pong");
+  if (fork() == 0) {
+    auto     in  = yos::shm_channel<Triangle>::open("/benchshm_ping");
+    auto     out = yos::shm_channel<Triangle>::open("/benchshm_pong");
+    Triangle t;
+    for (int i = 0; i != N; ++i) {
+      while (!in.read(t)) sched_yield();
+      out.write(t);
+    }
+    _exit(0);
+  }
+  usleep(100000);  // wait for the child to open channels
+  Triangle   t{{0, 0, 0, 0}, {1.1, 2.2, 3.3, 1}, {-3.3, -4.4, -5.5, 2}, "tri"};
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i != N; ++i) {
+    t.p1.id = i;
+    ping.write(t);
+    while (!rx.read(t)) sched_yield();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  wait(nullptr);
+  yos::shm_channel<Triangle>::remove("/benchshm_ping");
+  yos::shm_channel<Triangle>::remove("/benchshm_pong");
+  return std::chrono::duration<double, std::micro>(end - start).count() / N;
+}
+
+// reads one line. bytes after the line are kept in buf.
+std::string read_line(int s, std::string& buf) {
+  size_t eol;
+  while ((eol = buf.find('\n')) == std::string::npos) {
+    char          tmp[4096];
+    const ssize_t n = read(s, tmp, sizeof(tmp));
+    if (n <= 0) return std::string();
+    buf.append(tmp, n);
+  }
+  std::string line = buf.substr(0, eol);
+  buf.erase(0, eol + 1);
+  return line;
+}
+
+void write_json(int s, const Triangle& t) {
+  const std::string msg = nlohmann::json(t).dump() + "\n";
+  write(s, msg.data(), msg.size());
+}
+
+double socket_roundtrip() {
+  int fd[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fd);
+  if (fork() == 0) {
+    close(fd[0]);
+    std::string buf;
+    for (int i = 0; i != N; ++i) {
+      const Triangle t = nlohmann::json::parse(read_line(fd[1], buf));
+      write_json(fd[1], t);
+    }
+    _exit(0);
+  }
+  close(fd[1]);
+  std::string buf;
+  Triangle   t{{0, 0, 0, 0}, {1.1, 2.2, 3.3, 1}, {-3.3, -4.4, -5.5, 2}, "tri"};
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i != N; ++i) {
+    t.p1.id = i;
+    write_json(fd[0], t);
+    t = nlohmann::json::parse(read_line(fd[0], buf));
+  }
+  const auto end = std::chrono::steady_clock::now();
+  wait(nullptr);
+  close(fd[0]);
+  return std::chrono::duration<double, std::micro>(end - start).count() / N;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) N = std::stoi(argv[1]);
+  std::cout << "shm_channel     : " << shm_roundtrip() << " us/roundtrip"
+            << std::endl;
+  std::cout << "socket + dump() : " << socket_roundtrip() << " us/roundtrip"
+            << std::endl;
+}
@@ -0,0 +1,97 @@
+// String kernels and yos::dump() against nlohmann::json::dump() on
+// log-like records.
+// Build: c++ -std=c++14 -O2 -I<nlohmann/json include> benchstring.cc
+// Usage: benchstring [records]
+#include <chrono>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+#include "jsonutil_dump.hh"
+
+struct LogRecord {
+  double      t;
+  int         level;
+  std::string host, logger, message;
+  JSON_MEMBER(t, level, host, logger, message);
+};
+
+int N = 100000;
+
+std::vector<LogRecord> make_records() {
+  // mostly plain ASCII with occasional escapes and non-ASCII words
+  static const char* words[] = {
+      "GET",     "/api/v1/items", "200",     "took",     "ms",
+      "user",    "session",       "expired", "retrying", "connection",
+      "refused", "timeout",       "request", "id=42",    "upstream"};
+  static const char* rare[] = {"\"quoted\"", "path\\to", "caf\xc3\xa9",
+                               "\xe3\x83\xad\xe3\x82\xb0", "\n\t"};
+  std::mt19937           rng(1);
+  std::vector<LogRecord> v;
+  for (int i = 0; i != N; ++i) {
+    std::string msg;
+    const int   n = 10 + rng() % 100;
+    for (int k = 0; k != n; ++k) {
+      msg += rng() % 30 ? words[rng() % (sizeof(words) / sizeof(words[0]))]
+                        : rare[rng() % (sizeof(rare) / sizeof(rare[0]))];
+      msg += ' ';
+    }
+    v.push_back(LogRecord{1.5e9 + i * 0.001, int(rng() % 5), "host-017",
+                          "app.server.handler", msg});
+  }
+  return v;
+}
+
+template <typename F>
+double measure(F&& f) {
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) N = std::stoi(argv[1]);
+  const auto records = make_records();
+  size_t     bytes   = 0;
+  for (const auto& r : records) bytes += r.message.size();
+
+  std::string out;
+  size_t      text = 0;  // bytes of json text
+  const auto  mbps = [](size_t n, double s) { return n / s / 1e6; };
+
+  const double t_nl = measure([&] {
+    for (const auto& r : records) text += nlohmann::json(r).dump().size();
+  });
+  const double t_yos = measure([&] {
+    for (const auto& r : records) {
+      out.clear();
+      yos::dump_to(out, r);
+    }
+  });
+  std::cout << "nlohmann::json(r).dump() : " << mbps(text, t_nl) << " MB/s"
+            << std::endl;
+  std::cout << "yos::dump_to(out, r)     : " << mbps(text, t_yos) << " MB/s"
+            << std::endl;
+
+  const char* names[] = {"scalar", "sse2", "avx2"};
+  for (auto l : {yos::simd::scalar, yos::simd::sse2, yos::simd::avx2}) {
+    const auto& k = yos::string_kernels::get(l);
+    if (k.level != l) continue;
+    size_t      valid = 0;
+    const double t_escape = measure([&] {
+      for (const auto& r : records) {
+        out.clear();
+        yos::append_escaped(out, r.message.data(), r.message.size(), k);
+      }
+    });
+    const double t_utf8 = measure([&] {
+      for (const auto& r : records)
+        valid += k.validate_utf8(r.message.data(), r.message.size());
+    });
+    std::cout << names[int(l)] << " escape: " << mbps(bytes, t_escape)
+              << " MB/s, utf-8: " << mbps(bytes, t_utf8) << " MB/s ("
+              << valid << " valid)" << std::endl;
+  }
+}
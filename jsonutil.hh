@@ -37,8 +37,17 @@
 */
 
 #include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
 #include <typeinfo>
 #include <utility>
+#include <vector>
 
 #ifdef NOCONSTEXPR
 #define CONSTEXPR
@@ -46,6 +55,13 @@
 #define CONSTEXPR constexpr
 #endif
 
+// constexpr functions with C++14 bodies
+#if defined(NOCONSTEXPR) || __cplusplus < 201402L
+#define CONSTEXPR14
+#else
+#define CONSTEXPR14 constexpr
+#endif
+
 namespace yos {
 
 template <typename Char>
@@ -185,30 +201,63 @@ CONSTEXPR unsigned countargl(const char* s) { return countargl_impl(s, s); }
   JSON_MEMBER_OBJ(...)
   JSON_MEMBER_ARRAY(...)
 
+  macro defining output format of floating point members:
+  JSON_FLOAT_FORMAT(...)
+
   generic to_json/from_json
 */
 
 #define JSON_MEMBER(...)       \
   YOS_EMBED_NAMES(__VA_ARGS__) \
+  VISIT_MEMBERS_(__VA_ARGS__)  \
   FROM_JSON_(__VA_ARGS__)      \
   TO_JSON_ARRAY(__VA_ARGS__)   \
   TO_JSON_OBJ(__VA_ARGS__)
 
 #define JSON_MEMBER_OBJ(...)   \
   YOS_EMBED_NAMES(__VA_ARGS__) \
+  VISIT_MEMBERS_(__VA_ARGS__)  \
   FROM_JSON_(__VA_ARGS__)      \
   TO_JSON_OBJ(__VA_ARGS__)
 
 #define JSON_MEMBER_ARRAY(...) \
   YOS_EMBED_NAMES(__VA_ARGS__) \
+  VISIT_MEMBERS_(__VA_ARGS__)  \
   FROM_JSON_(__VA_ARGS__)      \
   TO_JSON_ARRAY(__VA_ARGS__)
 
+/*
+  visit_members_(f) calls f(pos, member) for each member in order
+  members_tie_() returns std::tuple of references to members
+*/
+#define VISIT_MEMBERS_(...)                                                 \
+  CONSTEXPR14 auto members_tie_() const->decltype(std::tie(__VA_ARGS__)) {  \
+    return std::tie(__VA_ARGS__);                                           \
+  }                                                                         \
+  CONSTEXPR14 auto members_tie_()->decltype(std::tie(__VA_ARGS__)) {        \
+    return std::tie(__VA_ARGS__);                                           \
+  }                                                                         \
+  template <typename F>                                                     \
+  void visit_members_(F&& f) {                                              \
+    visit_members_(f, 0, __VA_ARGS__);                                      \
+  }                                                                         \
+  template <typename F>                                                     \
+  void visit_members_(F&& f) const {                                        \
+    visit_members_(f, 0, __VA_ARGS__);                                      \
+  }                                                                         \
+  template <typename F, typename M1, typename... Ts>                        \
+  void visit_members_(F& f, size_t pos, M1& m, Ts&... rest) const {         \
+    f(pos, m);                                                              \
+    visit_members_(f, pos + 1, rest...);                                    \
+  }                                                                         \
+  template <typename F>                                                     \
+  void visit_members_(F& f, size_t pos) const {}
+
 #define FROM_JSON_(...)                                                     \
   template <typename BasicJsonType>                                         \
   void from_json(BasicJsonType&& j) {                                       \
     if (j.is_array())                                                       \
-      from_json_array(std::forward<BasicJsonType>(j), 0, __VA_ARGS__);      \
+      from_json_array(std::forward<BasicJsonType>(j), __VA_ARGS__);         \
     else                                                                    \
       from_json(std::forward<BasicJsonType>(j), 0, __VA_ARGS__);            \
   }                                                                         \
@@ -219,13 +268,59 @@ CONSTEXPR unsigned countargl(const char* s) { return countargl_impl(s, s); }
   }                                                                         \
   template <typename BasicJsonType>                                         \
   void from_json(const BasicJsonType& j, size_t pos) {}                     \
+  /* array form: one size check and a forward walk. see get_positional */   \
+  template <typename BasicJsonType, typename... Ts>                         \
+  void from_json_array(const BasicJsonType& j, Ts&... ms) {                 \
+    const auto& a =                                                         \
+        j.template get_ref<const typename BasicJsonType::array_t&>();       \
+    if (a.size() < members_size_())                                         \
+      throw BasicJsonType::out_of_range::create(                            \
+          401,                                                              \
+          "array index " + std::to_string(a.size()) + " is out of range",   \
+          &j);                                                              \
+    from_json_positional_(a.begin(), ms...);                                \
+  }                                                                         \
+  template <typename Itr, typename M1, typename... Ts>                      \
+  void from_json_positional_(Itr itr, M1& m, Ts&... rest) {                 \
+    yos::get_positional(*itr, m);                                           \
+    from_json_positional_(++itr, rest...);                                  \
+  }                                                                         \
+  template <typename Itr>                                                   \
+  void from_json_positional_(Itr itr) {}                                    \
+  /* exception free version of from_json(). see yos::try_from_json() */     \
+  template <typename BasicJsonType>                                         \
+  yos::result try_from_json(const BasicJsonType& j) {                       \
+    if (j.is_array()) return try_from_json_array(j, 0, __VA_ARGS__);        \
+    if (j.is_object()) return try_from_json(j, 0, __VA_ARGS__);             \
+    return yos::result{yos::errc::type_mismatch, {nullptr, 0}};             \
+  }                                                                         \
+  template <typename BasicJsonType, typename M1, typename... Ts>            \
+  yos::result try_from_json(const BasicJsonType& j, size_t pos, M1& m,      \
+                            Ts&... rest) {                                  \
+    const auto itr = j.find(membername_(pos));                              \
+    const auto r =                                                          \
+        itr == j.end() ? yos::result{yos::errc::missing_member, {nullptr, 0}} \
+                       : yos::try_get(*itr, m);                             \
+    if (!r) return r.at(membername_<std::pair<const char*, size_t>>(pos));  \
+    return try_from_json(j, pos + 1, rest...);                              \
+  }                                                                         \
+  template <typename BasicJsonType>                                         \
+  yos::result try_from_json(const BasicJsonType& j, size_t pos) {           \
+    return yos::result{yos::errc::ok, {nullptr, 0}};                        \
+  }                                                                         \
   template <typename BasicJsonType, typename M1, typename... Ts>            \
-  void from_json_array(BasicJsonType&& j, size_t pos, M1& m, Ts&... rest) { \
-    m = j.at(pos).template get<M1>();                                       \
-    from_json_array(std::forward<BasicJsonType>(j), pos + 1, rest...);      \
+  yos::result try_from_json_array(const BasicJsonType& j, size_t pos,       \
+                                  M1& m, Ts&... rest) {                     \
+    const auto r =                                                          \
+        pos < j.size() ? yos::try_get(j[pos], m)                            \
+                       : yos::result{yos::errc::out_of_range, {nullptr, 0}}; \
+    if (!r) return r.at(membername_<std::pair<const char*, size_t>>(pos));  \
+    return try_from_json_array(j, pos + 1, rest...);                        \
   }                                                                         \
   template <typename BasicJsonType>                                         \
-  void from_json_array(const BasicJsonType& j, size_t pos) {}
+  yos::result try_from_json_array(const BasicJsonType& j, size_t pos) {     \
+    return yos::result{yos::errc::ok, {nullptr, 0}};                        \
+  }
 
 #define TO_JSON_OBJ(...)                                                       \
   template <typename BasicJsonType>                                            \
@@ -246,12 +341,14 @@ CONSTEXPR unsigned countargl(const char* s) { return countargl_impl(s, s); }
   }                                                                            \
   template <typename BasicJsonType, typename M1, typename... Ts>               \
   void to_json_obj(BasicJsonType& j, size_t pos, M1&& m, Ts&&... rest) const { \
-    j.push_back({membername_(pos), m});                                        \
+    j.emplace(membername_<typename BasicJsonType::object_t::key_type>(pos),   \
+              yos::float_formatted(this, pos, m));                             \
     to_json_obj(j, pos + 1, rest...);                                          \
   }                                                                            \
   template <typename BasicJsonType, typename M1, typename... Ts>               \
   void to_json_obj_move(BasicJsonType& j, size_t pos, M1&& m, Ts&&... rest) {  \
-    j.push_back({membername_(pos), std::move(m)});                             \
+    j.emplace(membername_<typename BasicJsonType::object_t::key_type>(pos),   \
+              yos::float_formatted(this, pos, std::move(m)));                  \
     to_json_obj_move(j, pos + 1, rest...);                                     \
   }                                                                            \
   template <typename BasicJsonType>                                            \
@@ -281,13 +378,13 @@ CONSTEXPR unsigned countargl(const char* s) { return countargl_impl(s, s); }
   template <typename BasicJsonType, typename M1, typename... Ts>         \
   void to_json_array(BasicJsonType& j, size_t pos, M1&& m, Ts&&... rest) \
       const& {                                                           \
-    j.push_back(m);                                                      \
+    j.push_back(yos::float_formatted(this, pos, m));                     \
     to_json_array(j, pos + 1, std::forward<Ts>(rest)...);                \
   }                                                                      \
   template <typename BasicJsonType, typename M1, typename... Ts>         \
   void to_json_array_move(BasicJsonType& j, size_t pos, M1&& m,          \
                           Ts&&... rest) {                                \
-    j.push_back(std::move(m));                                           \
+    j.push_back(yos::float_formatted(this, pos, std::move(m)));          \
     to_json_array_move(j, pos + 1, std::forward<Ts>(rest)...);           \
   }                                                                      \
   template <typename BasicJsonType>                                      \
@@ -295,6 +392,42 @@ CONSTEXPR unsigned countargl(const char* s) { return countargl_impl(s, s); }
   template <typename BasicJsonType>                                      \
   void to_json_array_move(BasicJsonType& j, size_t pos) const {}
 
+/*
+  Output format of floating point members
+
+  JSON_FLOAT_FORMAT(...)
+    Placed next to JSON_MEMBER(). Takes one yos::float_format applied to all
+    floating point members, or one for each member in the order of
+    JSON_MEMBER(). Formats are also applied to elements of std::vector and
+    std::array of floating point type. Formats given to other members are
+    ignored.
+
+      struct pose {
+        double x, y, theta;
+        int    id;
+        JSON_MEMBER(x, y, theta, id);
+        JSON_FLOAT_FORMAT(yos::fixed_digits(3), yos::fixed_digits(3),
+                          yos::significant_digits(4), yos::full_precision());
+      };
+
+  Values are rounded when they are stored to json, and dump() prints the
+  shortest representation of the rounded value. Decoding is not affected.
+*/
+#ifdef NOCONSTEXPR
+#define JSON_FLOAT_FORMAT_CHECK_(N)
+#else
+#define JSON_FLOAT_FORMAT_CHECK_(N)                              \
+  static_assert(N == 1 || N == members_size_(),                  \
+                "JSON_FLOAT_FORMAT takes 1 or members_size_() formats");
+#endif
+
+#define JSON_FLOAT_FORMAT(...)                                            \
+  static const yos::float_format& json_float_format_(size_t pos) {        \
+    static const yos::float_format f[] = {__VA_ARGS__};                   \
+    JSON_FLOAT_FORMAT_CHECK_(sizeof(f) / sizeof(f[0]))                    \
+    return f[sizeof(f) / sizeof(f[0]) == 1 ? 0 : pos];                    \
+  }
+
 // meta
 #define DEFINE_HAS_MEMBER(FUN)                                           \
   template <typename T>                                                  \
@@ -321,6 +454,416 @@ CONSTEXPR unsigned countargl(const char* s) { return countargl_impl(s, s); }
   };
 
 namespace yos {
+// overload resolution order. priority<N> is preferred over priority<N - 1>.
+template <unsigned N>
+struct priority : priority<N - 1> {};
+template <>
+struct priority<0> {};
+
+// ------------------------------
+// json_enum : support functions of JSON_ENUM()
+template <typename E, typename SFINAE = void>
+struct is_json_enum : std::false_type {};
+template <typename E>
+struct is_json_enum<E, decltype(void(json_enum_names_(std::declval<E>())))>
+    : std::true_type {};
+
+// class holding names of E. see YOS_EMBED_NAMES
+template <typename E>
+using json_enum_names = decltype(json_enum_names_(std::declval<E>()));
+
+// defined in jsonutil_enum.hh
+template <typename E>
+std::pair<const char*, size_t> enum_name(E e);
+template <typename E>
+bool enum_from_name(const char* s, size_t n, E& e);
+template <typename BasicJsonType, typename E>
+void enum_from_json(const BasicJsonType& j, E& e);
+
+// ------------------------------
+// get_positional : decoding of array form
+/*
+  void get_positional(const BasicJsonType& j, T& m)
+    Same as m = j.get<T>(), used by from_json() of JSON_MEMBER() for arrays.
+    The member type selects the decoder at compile time and m is decoded in
+    place: structs and containers are filled element by element without
+    temporary copies, and numbers, bool and strings are read directly when
+    j holds the matching json type. Other cases fall back to j.get<T>(),
+    which also reports errors.
+*/
+template <typename BasicJsonType, typename T>
+void get_positional(const BasicJsonType& j, T& m);
+
+// struct with JSON_MEMBER()
+template <typename BasicJsonType, typename T>
+auto get_positional_(const BasicJsonType& j, T& m, priority<3>)
+    -> decltype(m.from_json(j)) {
+  m.from_json(j);
+}
+
+template <typename BasicJsonType, typename T>
+auto get_positional_(const BasicJsonType& j, T& m, priority<2>) ->
+    typename std::enable_if<is_json_enum<T>::value>::type {
+  enum_from_json(j, m);
+}
+
+template <typename BasicJsonType, typename T>
+auto get_positional_(const BasicJsonType& j, T& m, priority<2>) ->
+    typename std::enable_if<std::is_floating_point<T>::value>::type {
+  using F = typename BasicJsonType::number_float_t;
+  if (j.is_number_float())
+    m = static_cast<T>(*j.template get_ptr<const F*>());
+  else
+    m = j.template get<T>();
+}
+
+template <typename BasicJsonType, typename T>
+auto get_positional_(const BasicJsonType& j, T& m, priority<2>) ->
+    typename std::enable_if<std::is_integral<T>::value &&
+                            !std::is_same<T, bool>::value>::type {
+  using I = typename BasicJsonType::number_integer_t;
+  using U = typename BasicJsonType::number_unsigned_t;
+  if (j.is_number_unsigned())
+    m = static_cast<T>(*j.template get_ptr<const U*>());
+  else if (j.is_number_integer())
+    m = static_cast<T>(*j.template get_ptr<const I*>());
+  else
+    m = j.template get<T>();
+}
+
+template <typename BasicJsonType>
+void get_positional_(const BasicJsonType& j, bool& m, priority<2>) {
+  using B = typename BasicJsonType::boolean_t;
+  m = j.is_boolean() ? *j.template get_ptr<const B*>() : j.template get<bool>();
+}
+
+template <typename BasicJsonType>
+void get_positional_(const BasicJsonType& j, std::string& m, priority<2>) {
+  using S = typename BasicJsonType::string_t;
+  if (j.is_string())
+    m = *j.template get_ptr<const S*>();
+  else
+    m = j.template get<std::string>();
+}
+
+template <typename BasicJsonType, typename T, typename A>
+auto get_positional_(const BasicJsonType& j, std::vector<T, A>& m,
+                     priority<2>) ->
+    typename std::enable_if<!std::is_same<T, bool>::value &&
+                            std::is_default_constructible<T>::value>::type {
+  using V = typename BasicJsonType::array_t;
+  if (!j.is_array()) {
+    m = j.template get<std::vector<T, A>>();
+    return;
+  }
+  const V& a = *j.template get_ptr<const V*>();
+  m.resize(a.size());
+  auto out = m.begin();
+  for (const auto& e : a) get_positional(e, *out++);
+}
+
+template <typename BasicJsonType, typename T, size_t N>
+void get_positional_(const BasicJsonType& j, std::array<T, N>& m,
+                     priority<2>) {
+  using V = typename BasicJsonType::array_t;
+  if (!j.is_array() || j.size() < N) {
+    m = j.template get<std::array<T, N>>();
+    return;
+  }
+  const V& a = *j.template get_ptr<const V*>();
+  for (size_t i = 0; i != N; ++i) get_positional(a[i], m[i]);
+}
+
+// others
+template <typename BasicJsonType, typename T>
+void get_positional_(const BasicJsonType& j, T& m, priority<0>) {
+  m = j.template get<T>();
+}
+
+template <typename BasicJsonType, typename T>
+void get_positional(const BasicJsonType& j, T& m) {
+  get_positional_(j, m, priority<3>());
+}
+
+// ------------------------------
+// try_from_json : decoding without exceptions
+/*
+  yos::result try_from_json(const BasicJsonType& j, T& obj)
+    Decodes j into obj like j.get<T>() but reports missing members and type
+    mismatches by the returned value instead of throwing. Usable with
+    -fno-exceptions.
+
+    Members of structs marked with JSON_MEMBER(), arithmetic types, bool,
+    enumerations, std::string, std::vector and std::array are checked
+    before conversion. Other types (e.g. std::map or types with their own
+    adl_serializer) are converted by j.get<T>() as is, which throws on
+    malformed input.
+
+    On failure, result::member holds the name of the innermost member which
+    failed. The name is not null-terminated. obj is partially updated.
+*/
+enum class errc {
+  ok,
+  missing_member,  // object does not have the member
+  type_mismatch,   // json value type does not match to the member type
+  out_of_range,    // array is shorter than required
+  unknown_name     // string is not a name of JSON_ENUM() enumeration
+};
+
+struct result {
+  errc                           kind;
+  std::pair<const char*, size_t> member;
+
+  explicit operator bool() const { return kind == errc::ok; }
+  std::string member_name() const {
+    return member.first ? std::string(member.first, member.second)
+                        : std::string();
+  }
+  // set member name if not set by inner member yet
+  result at(const std::pair<const char*, size_t>& name) const {
+    return member.first ? *this : result{kind, name};
+  }
+};
+
+template <typename BasicJsonType, typename T>
+result try_get(const BasicJsonType& j, T& m);
+
+// struct with JSON_MEMBER()
+template <typename BasicJsonType, typename T>
+auto try_get_(const BasicJsonType& j, T& m, priority<2>)
+    -> decltype(m.try_from_json(j)) {
+  return m.try_from_json(j);
+}
+
+template <typename BasicJsonType, typename T>
+auto try_get_(const BasicJsonType& j, T& m, priority<1>) ->
+    typename std::enable_if<std::is_arithmetic<T>::value &&
+                                !std::is_same<T, bool>::value,
+                            result>::type {
+  if (!j.is_number()) return result{errc::type_mismatch, {nullptr, 0}};
+  m = j.template get<T>();
+  return result{errc::ok, {nullptr, 0}};
+}
+
+template <typename BasicJsonType, typename T>
+auto try_get_(const BasicJsonType& j, T& m, priority<1>) ->
+    typename std::enable_if<is_json_enum<T>::value, result>::type {
+  if (!j.is_string()) return result{errc::type_mismatch, {nullptr, 0}};
+  const auto& s = j.template get_ref<const typename BasicJsonType::string_t&>();
+  if (!enum_from_name(s.data(), s.size(), m))
+    return result{errc::unknown_name, {nullptr, 0}};
+  return result{errc::ok, {nullptr, 0}};
+}
+
+// enumeration without JSON_ENUM(), stored as its value
+template <typename BasicJsonType, typename T>
+auto try_get_(const BasicJsonType& j, T& m, priority<1>) ->
+    typename std::enable_if<std::is_enum<T>::value && !is_json_enum<T>::value,
+                            result>::type {
+  if (!j.is_number_integer()) return result{errc::type_mismatch, {nullptr, 0}};
+  m = j.template get<T>();
+  return result{errc::ok, {nullptr, 0}};
+}
+
+template <typename BasicJsonType>
+result try_get_(const BasicJsonType& j, bool& m, priority<1>) {
+  if (!j.is_boolean()) return result{errc::type_mismatch, {nullptr, 0}};
+  m = j.template get<bool>();
+  return result{errc::ok, {nullptr, 0}};
+}
+
+template <typename BasicJsonType>
+result try_get_(const BasicJsonType& j, std::string& m, priority<1>) {
+  if (!j.is_string()) return result{errc::type_mismatch, {nullptr, 0}};
+  m = j.template get_ref<const typename BasicJsonType::string_t&>();
+  return result{errc::ok, {nullptr, 0}};
+}
+
+template <typename BasicJsonType, typename T, typename A>
+result try_get_(const BasicJsonType& j, std::vector<T, A>& m, priority<1>) {
+  if (!j.is_array()) return result{errc::type_mismatch, {nullptr, 0}};
+  m.resize(j.size());
+  for (size_t i = 0; i != m.size(); ++i) {
+    const auto r = try_get(j[i], m[i]);
+    if (!r) return r;
+  }
+  return result{errc::ok, {nullptr, 0}};
+}
+
+// elements of std::vector<bool> are not addressable
+template <typename BasicJsonType, typename A>
+result try_get_(const BasicJsonType& j, std::vector<bool, A>& m, priority<1>) {
+  if (!j.is_array()) return result{errc::type_mismatch, {nullptr, 0}};
+  m.resize(j.size());
+  for (size_t i = 0; i != m.size(); ++i) {
+    bool       b;
+    const auto r = try_get(j[i], b);
+    if (!r) return r;
+    m[i] = b;
+  }
+  return result{errc::ok, {nullptr, 0}};
+}
+
+template <typename BasicJsonType, typename T, size_t N>
+result try_get_(const BasicJsonType& j, std::array<T, N>& m, priority<1>) {
+  if (!j.is_array()) return result{errc::type_mismatch, {nullptr, 0}};
+  if (j.size() < N) return result{errc::out_of_range, {nullptr, 0}};
+  for (size_t i = 0; i != N; ++i) {
+    const auto r = try_get(j[i], m[i]);
+    if (!r) return r;
+  }
+  return result{errc::ok, {nullptr, 0}};
+}
+
+// others
+template <typename BasicJsonType, typename T>
+result try_get_(const BasicJsonType& j, T& m, priority<0>) {
+  m = j.template get<T>();
+  return result{errc::ok, {nullptr, 0}};
+}
+
+template <typename BasicJsonType, typename T>
+result try_get(const BasicJsonType& j, T& m) {
+  return try_get_(j, m, priority<2>());
+}
+
+template <typename BasicJsonType, typename T>
+result try_from_json(const BasicJsonType& j, T& obj) {
+  return try_get(j, obj);
+}
+
+// ------------------------------
+// float_format : rounding policy for JSON_FLOAT_FORMAT()
+/*
+  fixed and significant round by scaling with an exact power of ten: one
+  multiplication, std::round() and one division per value (significant adds
+  std::log10()). float32 tries 6 to 9 significant digits in the same way
+  until the value reads back to the same float. Values which would need a
+  power of ten beyond 10^22 fall back to snprintf() and strtod().
+*/
+struct float_format {
+  enum class kind { full, fixed, significant, float32 };
+  kind k;
+  int  digits;
+
+  double operator()(double v) const {
+    if (k == kind::full || !std::isfinite(v)) return v;
+    switch (k) {
+      case kind::fixed:
+        return scaled(v, digits);
+      case kind::significant:
+        return rounded(v, digits);
+      case kind::float32: {
+        // shortest decimal which reads back to the same float
+        const float f = static_cast<float>(v);
+        double      r = f;
+        for (int p = 6; p <= 9; ++p) {
+          r = rounded(f, p);
+          if (static_cast<float>(r) == f) break;
+        }
+        return r;
+      }
+      default:
+        return v;
+    }
+  }
+
+private:
+  static double pow10(int n) {  // exact for 0 <= n <= 22
+    static const double p[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                               1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                               1e18, 1e19, 1e20, 1e21, 1e22};
+    return p[n];
+  }
+
+  // v rounded at 10^-n
+  static double scaled(double v, int n) {
+    double r;
+    if (n >= 0 && n <= 22) {
+      r = std::round(v * pow10(n));
+      if (std::fabs(r) >= 9007199254740992.0) return v;  // 2^53
+      r /= pow10(n);
+    } else if (n < 0 && n >= -22) {
+      r = std::round(v / pow10(-n)) * pow10(-n);
+    } else {
+      return v;
+    }
+    return r == 0 ? 0 : r;  // not -0 for small negative values
+  }
+
+  // v rounded to n significant digits
+  static double rounded(double v, int n) {
+    if (v == 0) return 0;
+    if (n > 15) return v;
+    const int e = static_cast<int>(std::floor(std::log10(std::fabs(v))));
+    if (n - 1 - e > 22 || n - 1 - e < -22) {
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%.*e", n - 1, v);
+      return std::strtod(buf, nullptr);
+    }
+    return scaled(v, n - 1 - e);
+  }
+};
+
+// 'digits' digits after decimal point
+CONSTEXPR float_format fixed_digits(int digits) {
+  return float_format{float_format::kind::fixed, digits};
+}
+// 'digits' significant digits
+CONSTEXPR float_format significant_digits(int digits) {
+  return float_format{float_format::kind::significant, digits};
+}
+// precision of float
+CONSTEXPR float_format float32_roundtrip() {
+  return float_format{float_format::kind::float32, 9};
+}
+CONSTEXPR float_format full_precision() {
+  return float_format{float_format::kind::full, 17};
+}
+
+// applies C::json_float_format_(pos) to floating point member m if defined.
+template <typename C, typename M>
+auto float_formatted_(const C*, size_t pos, M&& m, priority<1>) ->
+    typename std::enable_if<
+        std::is_floating_point<typename std::decay<M>::type>::value,
+        decltype(C::json_float_format_(pos)(m))>::type {
+  return C::json_float_format_(pos)(m);
+}
+// floating point elements of std::vector and std::array members. elements
+// are widened to double like scalar members, so that rounding is kept.
+template <typename C, typename F, typename A>
+auto float_formatted_(const C*, size_t pos, const std::vector<F, A>& m,
+                      priority<1>) ->
+    typename std::enable_if<std::is_floating_point<F>::value,
+                            decltype(C::json_float_format_(pos),
+                                     std::vector<double>())>::type {
+  const float_format& f = C::json_float_format_(pos);
+  std::vector<double> v(m.size());
+  for (size_t i = 0; i != m.size(); ++i) v[i] = f(m[i]);
+  return v;
+}
+template <typename C, typename F, size_t N>
+auto float_formatted_(const C*, size_t pos, const std::array<F, N>& m,
+                      priority<1>) ->
+    typename std::enable_if<std::is_floating_point<F>::value,
+                            decltype(C::json_float_format_(pos),
+                                     std::array<double, N>())>::type {
+  const float_format&   f = C::json_float_format_(pos);
+  std::array<double, N> a;
+  for (size_t i = 0; i != N; ++i) a[i] = f(m[i]);
+  return a;
+}
+template <typename C, typename M>
+M&& float_formatted_(const C*, size_t pos, M&& m, priority<0>) {
+  return std::forward<M>(m);
+}
+template <typename C, typename M>
+auto float_formatted(const C* c, size_t pos, M&& m)
+    -> decltype(float_formatted_(c, pos, std::forward<M>(m), priority<1>())) {
+  return float_formatted_(c, pos, std::forward<M>(m), priority<1>());
+}
+
 // helper class for detecting some serialize methids
 DEFINE_HAS_TEMPLATE_MEMBER(to_json_array);
 DEFINE_HAS_TEMPLATE_MEMBER(to_json_obj);
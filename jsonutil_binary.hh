@@ -0,0 +1,254 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  Compact positional binary form of structs marked with JSON_MEMBER().
+
+  Members are written in the order of JSON_MEMBER() without names, like
+  yos::array_json. Layout is the native one of the host; it is meant for
+  processes on the same machine.
+
+    arithmetic, enum      raw bytes
+    std::string           uint32_t length, bytes
+    std::vector<T>        uint32_t count, elements
+    std::array<T, N>      elements
+    JSON_MEMBER struct    members in order
+
+  std::vector<bool> is not supported.
+
+  Accessing API
+    size_t pack(char* buf, size_t n, const T& v)
+      Writes v to buf. Returns number of bytes written, or 0 if v does not
+      fit in n bytes.
+
+    bool unpack(const char* buf, size_t n, T& v)
+      Reads v from buf. Returns false on truncated input.
+
+    uint64_t schema_fingerprint<T>()
+      Hash of member names and member types of T, nested structs included.
+*/
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "jsonutil.hh"
+
+namespace yos {
+
+struct packer {
+  char* p;
+  char* end;
+  bool  ok;
+
+  void put(const void* s, size_t n) {
+    if (!ok || size_t(end - p) < n) {
+      ok = false;
+      return;
+    }
+    std::memcpy(p, s, n);
+    p += n;
+  }
+};
+
+struct unpacker {
+  const char* p;
+  const char* end;
+  bool        ok;
+
+  void get(void* d, size_t n) {
+    if (!ok || size_t(end - p) < n) {
+      ok = false;
+      return;
+    }
+    std::memcpy(d, p, n);
+    p += n;
+  }
+  // element count read from input. rejects counts larger than the rest.
+  bool count(uint32_t& n) {
+    get(&n, sizeof(n));
+    ok = ok && n <= size_t(end - p);
+    return ok;
+  }
+};
+
+template <typename T>
+struct is_raw_packed
+    : std::integral_constant<bool, std::is_arithmetic<T>::value ||
+                                       std::is_enum<T>::value> {};
+
+//-------------------------------------------------- pack
+template <typename T>
+void pack_(packer& w, const T& v);
+
+template <typename T>
+auto pack_impl(packer& w, const T& v, priority<2>)
+    -> decltype(T::members_size_(), void()) {
+  v.visit_members_([&w](size_t, const auto& m) { pack_(w, m); });
+}
+
+template <typename T>
+auto pack_impl(packer& w, const T& v, priority<1>) ->
+    typename std::enable_if<is_raw_packed<T>::value>::type {
+  w.put(&v, sizeof(v));
+}
+
+inline void pack_impl(packer& w, const std::string& v, priority<1>) {
+  const uint32_t n = v.size();
+  w.put(&n, sizeof(n));
+  w.put(v.data(), n);
+}
+
+template <typename T, typename A>
+void pack_impl(packer& w, const std::vector<T, A>& v, priority<1>) {
+  const uint32_t n = v.size();
+  w.put(&n, sizeof(n));
+  if (is_raw_packed<T>::value) return w.put(v.data(), n * sizeof(T));
+  for (const auto& e : v) pack_(w, e);
+}
+
+template <typename T, size_t N>
+void pack_impl(packer& w, const std::array<T, N>& v, priority<1>) {
+  for (const auto& e : v) pack_(w, e);
+}
+
+template <typename T>
+void pack_(packer& w, const T& v) {
+  pack_impl(w, v, priority<2>());
+}
+
+template <typename T>
+size_t pack(char* buf, size_t n, const T& v) {
+  packer w{buf, buf + n, true};
+  pack_(w, v);
+  return w.ok ? w.p - buf : 0;
+}
+
+//-------------------------------------------------- unpack
+template <typename T>
+void unpack_(unpacker& r, T& v);
+
+template <typename T>
+auto unpack_impl(unpacker& r, T& v, priority<2>)
+    -> decltype(T::members_size_(), void()) {
+  v.visit_members_([&r](size_t, auto& m) { unpack_(r, m); });
+}
+
+template <typename T>
+auto unpack_impl(unpacker& r, T& v, priority<1>) ->
+    typename std::enable_if<is_raw_packed<T>::value>::type {
+  r.get(&v, sizeof(v));
+}
+
+inline void unpack_impl(unpacker& r, std::string& v, priority<1>) {
+  uint32_t n;
+  if (!r.count(n)) return;
+  v.assign(r.p, n);
+  r.p += n;
+}
+
+template <typename T, typename A>
+void unpack_impl(unpacker& r, std::vector<T, A>& v, priority<1>) {
+  uint32_t n;
+  if (!r.count(n)) return;
+  v.resize(n);
+  if (is_raw_packed<T>::value) return r.get(v.data(), n * sizeof(T));
+  for (auto& e : v) unpack_(r, e);
+}
+
+template <typename T, size_t N>
+void unpack_impl(unpacker& r, std::array<T, N>& v, priority<1>) {
+  for (auto& e : v) unpack_(r, e);
+}
+
+template <typename T>
+void unpack_(unpacker& r, T& v) {
+  unpack_impl(r, v, priority<2>());
+}
+
+template <typename T>
+bool unpack(const char* buf, size_t n, T& v) {
+  unpacker r{buf, buf + n, true};
+  unpack_(r, v);
+  return r.ok;
+}
+
+//-------------------------------------------------- schema_fingerprint
+// FNV-1a
+inline uint64_t fnv1a(uint64_t h, const void* s, size_t n) {
+  for (size_t i = 0; i != n; ++i)
+    h = (h ^ static_cast<const unsigned char*>(s)[i]) * 1099511628211ull;
+  return h;
+}
+inline uint64_t fnv1a(uint64_t h, char tag, size_t n) {
+  h = fnv1a(h, &tag, 1);
+  return fnv1a(h, &n, sizeof(n));
+}
+
+template <typename T>
+void fingerprint_(uint64_t& h, const T& v);
+
+template <typename T>
+auto fingerprint_impl(uint64_t& h, const T& v, priority<2>)
+    -> decltype(T::members_size_(), void()) {
+  h = fnv1a(h, '{', T::members_size_());
+  for (size_t i = 0; i != T::members_size_(); ++i) {
+    const auto name = T::membername_const_(i);
+    h = fnv1a(h, ':', name.second);
+    h = fnv1a(h, name.first, name.second);
+  }
+  v.visit_members_([&h](size_t, const auto& m) { fingerprint_(h, m); });
+}
+
+template <typename T>
+auto fingerprint_impl(uint64_t& h, const T& v, priority<1>) ->
+    typename std::enable_if<is_raw_packed<T>::value>::type {
+  h = fnv1a(h,
+            std::is_floating_point<T>::value
+                ? 'f'
+                : std::is_enum<T>::value ? 'e'
+                                         : std::is_signed<T>::value ? 'i' : 'u',
+            sizeof(T));
+}
+
+inline void fingerprint_impl(uint64_t& h, const std::string&, priority<1>) {
+  h = fnv1a(h, 's', 0);
+}
+
+template <typename T, typename A>
+void fingerprint_impl(uint64_t& h, const std::vector<T, A>&, priority<1>) {
+  h = fnv1a(h, 'v', 0);
+  fingerprint_(h, T());
+}
+
+template <typename T, size_t N>
+void fingerprint_impl(uint64_t& h, const std::array<T, N>&, priority<1>) {
+  h = fnv1a(h, 'a', N);
+  fingerprint_(h, T());
+}
+
+template <typename T>
+void fingerprint_(uint64_t& h, const T& v) {
+  fingerprint_impl(h, v, priority<2>());
+}
+
+template <typename T>
+uint64_t schema_fingerprint() {
+  uint64_t h = 14695981039346656037ull;
+  fingerprint_(h, T());
+  return h;
+}
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  Direct writer for structs marked with JSON_MEMBER().
+
+    std::string dump(const T& v)
+    void dump_to(std::string& out, const T& v)
+      Writes the same text as nlohmann::json(v).dump() without building
+      nlohmann::json. dump_to() appends to out.
+
+  Members are written in the form nlohmann::json would choose: objects with
+  members sorted by name if T has JSON_MEMBER() or JSON_MEMBER_OBJ(), arrays
+  for JSON_MEMBER_ARRAY(). JSON_FLOAT_FORMAT() and JSON_ENUM() are applied.
+  Arithmetic types, bool, std::string, std::vector and std::array are
+  written directly; other types are converted by nlohmann::json.
+
+  Strings are checked by validate_utf8 and escaped by the kernels of
+  jsonutil_string.hh. Invalid UTF-8 throws nlohmann::json::type_error like
+  dump().
+*/
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "jsonutil.hh"
+#include "jsonutil_string.hh"
+
+namespace yos {
+
+template <typename T>
+void dump_value_(std::string& out, const T& v);
+
+// writes member I of v
+template <typename T, size_t I>
+void dump_member_(std::string& out, const T& v) {
+  dump_value_(out, float_formatted(&v, I, std::get<I>(v.members_tie_())));
+}
+
+// dump_member_() of each member, indexed by position
+template <typename T, size_t... I>
+const std::array<void (*)(std::string&, const T&), sizeof...(I)>&
+member_dumpers_(std::index_sequence<I...>) {
+  static const std::array<void (*)(std::string&, const T&), sizeof...(I)> f{
+      {&dump_member_<T, I>...}};
+  return f;
+}
+
+// JSON_MEMBER struct
+template <typename T>
+auto dump_impl(std::string& out, const T& v, priority<3>)
+    -> decltype(T::members_size_(), void()) {
+  using token          = std::pair<const char*, size_t>;
+  constexpr size_t n   = T::members_size_();
+  const bool       obj = has_to_json_obj<T, nlohmann::json>::value;
+  // member positions in the order of names
+  static const std::array<size_t, n> order = [] {
+    std::array<size_t, n> o;
+    for (size_t i = 0; i != n; ++i) o[i] = i;
+    if (has_to_json_obj<T, nlohmann::json>::value) {
+      std::sort(o.begin(), o.end(), [](size_t a, size_t b) {
+        const token x = T::template membername_<token>(a);
+        const token y = T::template membername_<token>(b);
+        return std::string(x.first, x.second) < std::string(y.first, y.second);
+      });
+    }
+    return o;
+  }();
+  const auto& dump = member_dumpers_<T>(std::make_index_sequence<n>());
+  out += obj ? '{' : '[';
+  for (size_t k = 0; k != n; ++k) {
+    if (k) out += ',';
+    if (obj) {
+      const token name = T::template membername_<token>(order[k]);
+      out += '"';
+      out.append(name.first, name.second);
+      out += "\":";
+    }
+    dump[order[k]](out, v);
+  }
+  out += obj ? '}' : ']';
+}
+
+template <typename T>
+auto dump_impl(std::string& out, const T& v, priority<2>) ->
+    typename std::enable_if<is_json_enum<T>::value>::type {
+  const auto name = enum_name(v);
+  out += '"';
+  out.append(name.first, name.second);
+  out += '"';
+}
+
+template <typename T>
+auto dump_impl(std::string& out, T v, priority<2>) ->
+    typename std::enable_if<std::is_same<T, bool>::value>::type {
+  out += v ? "true" : "false";
+}
+
+/*
+  Shortest round-trip digits of finite d, written exactly as dump() of
+  nlohmann::json writes them so that the output matches byte for byte.
+  nlohmann::detail::to_chars() is not public API; this is the only place it
+  is called and its signature is unchanged throughout json 3.x.
+*/
+#if defined(NLOHMANN_JSON_VERSION_MAJOR) && NLOHMANN_JSON_VERSION_MAJOR != 3
+#error "jsonutil_dump.hh: dump_double() needs nlohmann::json 3.x"
+#endif
+inline char* dump_double(char* first, char* last, double d) {
+  return nlohmann::detail::to_chars(first, last, d);
+}
+
+template <typename T>
+auto dump_impl(std::string& out, T v, priority<1>) ->
+    typename std::enable_if<std::is_floating_point<T>::value>::type {
+  const double d = v;
+  if (!std::isfinite(d)) {
+    out += "null";
+    return;
+  }
+  char buf[64];
+  out.append(buf, dump_double(buf, buf + sizeof(buf), d));
+}
+
+template <typename T>
+auto dump_impl(std::string& out, T v, priority<1>) ->
+    typename std::enable_if<std::is_integral<T>::value ||
+                            std::is_enum<T>::value>::type {
+  using I = typename std::conditional<std::is_enum<T>::value,
+                                      std::underlying_type<T>,
+                                      std::common_type<T>>::type::type;
+  const I  i = static_cast<I>(v);
+  uint64_t u = i < 0 ? 0 - static_cast<uint64_t>(i) : static_cast<uint64_t>(i);
+  char     buf[20];
+  char*    p = buf + sizeof(buf);
+  do {
+    *--p = static_cast<char>('0' + u % 10);
+    u /= 10;
+  } while (u);
+  if (i < 0) out += '-';
+  out.append(p, buf + sizeof(buf));
+}
+
+inline void dump_impl(std::string& out, const std::string& v, priority<1>) {
+  const auto& k = string_kernels::best();
+  if (!k.validate_utf8(v.data(), v.size())) {
+    out += nlohmann::json(v).dump();  // throws type_error
+    return;
+  }
+  append_escaped(out, v.data(), v.size(), k);
+}
+
+template <typename T>
+void dump_elements(std::string& out, const T& v) {
+  out += '[';
+  bool first = true;
+  for (const auto& e : v) {
+    if (!first) out += ',';
+    first = false;
+    dump_value_(out, e);
+  }
+  out += ']';
+}
+
+template <typename T, typename A>
+auto dump_impl(std::string& out, const std::vector<T, A>& v, priority<1>) ->
+    typename std::enable_if<!std::is_same<T, bool>::value>::type {
+  dump_elements(out, v);
+}
+
+template <typename T, size_t N>
+void dump_impl(std::string& out, const std::array<T, N>& v, priority<1>) {
+  dump_elements(out, v);
+}
+
+template <typename T>
+void dump_impl(std::string& out, const T& v, priority<0>) {
+  out += nlohmann::json(v).dump();
+}
+
+template <typename T>
+void dump_value_(std::string& out, const T& v) {
+  dump_impl(out, v, priority<3>());
+}
+
+template <typename T>
+void dump_to(std::string& out, const T& v) {
+  dump_value_(out, v);
+}
+
+template <typename T>
+std::string dump(const T& v) {
+  std::string out;
+  dump_to(out, v);
+  return out;
+}
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  Enumerations stored as names
+
+  JSON_ENUM(E, ...)
+    Placed in the namespace of enum E, not in a class. Lists all
+    enumerators of E in the order of declaration. Values of enumerators
+    must be 0, 1, 2, ... (the default).
+
+      enum class mode { idle, run, stop };
+      JSON_ENUM(mode, idle, run, stop);
+
+  E is stored as the name of its enumerator wherever nlohmann::json
+  converts E: j = e, j.get<E>(), JSON_MEMBER() members, containers,
+  array_json and map_json. Names are looked up in a perfect hash table
+  built at compile time. Converting an unknown name or an unlisted value
+  throws BasicJsonType::out_of_range.
+
+  The table is built by C++14 constexpr functions, so this header needs
+  C++14 while jsonutil.hh works with C++11.
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include "jsonutil.hh"
+
+#define JSON_ENUM(E, ...)                                                  \
+  struct E##_json_enum_ {                                                  \
+    YOS_EMBED_NAMES(__VA_ARGS__)                                           \
+  };                                                                       \
+  template <typename BasicJsonType>                                        \
+  void to_json(BasicJsonType& j, const E& e) {                             \
+    yos::enum_to_json(j, e);                                               \
+  }                                                                        \
+  template <typename BasicJsonType>                                        \
+  void from_json(const BasicJsonType& j, E& e) {                           \
+    yos::enum_from_json(j, e);                                             \
+  }                                                                        \
+  /* found by ADL. see yos::json_enum_names */                             \
+  E##_json_enum_ json_enum_names_(E)
+
+namespace yos {
+
+CONSTEXPR uint32_t enum_hash(const char* s, size_t n, uint32_t seed) {
+  uint32_t h = 2166136261u ^ (seed * 2654435761u);
+  for (size_t i = 0; i != n; ++i)
+    h = (h ^ static_cast<unsigned char>(s[i])) * 16777619u;
+  return h ^ (h >> 16);
+}
+
+CONSTEXPR size_t enum_slots(size_t n) {
+  size_t m = 1;
+  while (m < n) m *= 2;
+  return m;
+}
+
+/*
+  Perfect hash of N names (hash and displace).
+  A name s is in bucket enum_hash(s, 0) and bucket b places its names at
+  slot enum_hash(s, disp[b]). slot[] holds index + 1 of the name, 0 if empty.
+*/
+template <size_t N, size_t M = enum_slots(N)>
+struct enum_table {
+  const char* name[N];
+  size_t      len[N];
+  uint32_t    disp[M];
+  size_t      slot[2 * M];
+  bool        ok;
+
+  CONSTEXPR size_t bucket(const char* s, size_t n) const {
+    return enum_hash(s, n, 0) & (M - 1);
+  }
+  CONSTEXPR size_t place(const char* s, size_t n, uint32_t d) const {
+    return enum_hash(s, n, d) & (2 * M - 1);
+  }
+  // index of name s, or N if s is not in the table
+  size_t find(const char* s, size_t n) const {
+    const size_t i = slot[place(s, n, disp[bucket(s, n)])];
+    return i != 0 && len[i - 1] == n && std::memcmp(name[i - 1], s, n) == 0
+               ? i - 1
+               : N;
+  }
+};
+
+template <size_t N, size_t M = enum_slots(N)>
+CONSTEXPR enum_table<N, M> make_enum_table(const char* names) {
+  enum_table<N, M> t{};
+  const auto tok = tokenize<N>(names);
+  size_t     b[N]{};
+  size_t     count[M]{};
+  for (size_t i = 0; i != N; ++i) {
+    t.name[i] = tok[i].first;
+    t.len[i]  = tok[i].second;
+    b[i]      = t.bucket(t.name[i], t.len[i]);
+    ++count[b[i]];
+  }
+  t.ok = true;
+  // larger buckets first
+  for (size_t size = N; size != 0; --size) {
+    for (size_t k = 0; k != M; ++k) {
+      if (count[k] != size) continue;
+      bool placed = false;
+      for (uint32_t d = 1; !placed && d != 1u << 20; ++d) {
+        placed = true;
+        for (size_t i = 0; i != N && placed; ++i) {
+          if (b[i] != k) continue;
+          size_t& s = t.slot[t.place(t.name[i], t.len[i], d)];
+          if (s == 0)
+            s = i + 1;
+          else
+            placed = false;
+        }
+        if (placed) {
+          t.disp[k] = d;
+        } else {  // undo
+          for (size_t i = 0; i != N; ++i) {
+            size_t& s = t.slot[t.place(t.name[i], t.len[i], d)];
+            if (b[i] == k && s == i + 1) s = 0;
+          }
+        }
+      }
+      t.ok = t.ok && placed;  // fails on duplicated names
+    }
+  }
+  return t;
+}
+
+// name of e
+template <typename E>
+std::pair<const char*, size_t> enum_name(E e) {
+  using names = json_enum_names<E>;
+  const size_t i = static_cast<size_t>(e);
+  if (i >= names::members_size_())
+    throw nlohmann::json::out_of_range::create(
+        401, "JSON_ENUM: value " + std::to_string(i) + " is not listed",
+        nullptr);
+  return names::template membername_<std::pair<const char*, size_t>>(i);
+}
+
+// enumerator named s. false if s is not a name of E.
+template <typename E>
+bool enum_from_name(const char* s, size_t n, E& e) {
+  using names = json_enum_names<E>;
+  CONSTEXPR static const auto t =
+      make_enum_table<names::members_size_()>(names::members_());
+#ifndef NOCONSTEXPR
+  static_assert(t.ok, "JSON_ENUM: duplicated names");
+#endif
+  const size_t i = t.find(s, n);
+  if (i == names::members_size_()) return false;
+  e = static_cast<E>(i);
+  return true;
+}
+
+template <typename BasicJsonType, typename E>
+void enum_to_json(BasicJsonType& j, E e) {
+  const auto name = enum_name(e);
+  j = typename BasicJsonType::string_t(name.first, name.second);
+}
+
+template <typename BasicJsonType, typename E>
+void enum_from_json(const BasicJsonType& j, E& e) {
+  const auto& s = j.template get_ref<const typename BasicJsonType::string_t&>();
+  if (!enum_from_name(s.data(), s.size(), e))
+    throw BasicJsonType::out_of_range::create(
+        403, "JSON_ENUM: unknown name '" + std::string(s) + "'", &j);
+}
+}
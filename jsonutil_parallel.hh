@@ -0,0 +1,377 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  Parallel decoding of large documents.
+
+    void parallel_parse(const char* s, size_t n, T& v, unsigned threads = 0)
+    T parallel_parse<T>(const char* s, size_t n, unsigned threads = 0)
+      Decodes document s into v like BasicJsonType::parse(s, s + n).get<T>()
+      without building the DOM of the whole document.
+
+  Members of structs marked with JSON_MEMBER() are located one by one, in
+  object form or array form. Values of unknown members and extra elements
+  of the array form are checked by BasicJsonType::accept() and skipped.
+  A std::vector member larger than
+  parallel_min_bytes is split into its elements, the vector is resized to
+  the number of elements and the elements are decoded by 'threads' threads
+  (std::thread::hardware_concurrency() if 0). Each element is decoded by
+  BasicJsonType::parse() and get<>(), i.e. by from_json() of JSON_MEMBER().
+  T may also be a std::vector itself.
+
+  Element boundaries are found by element_scanner, which classifies 64
+  bytes at a time (SSE2 where available) and tracks strings and escapes with
+  bit masks. Object keys are scanned and checked for UTF-8 by the kernels of
+  jsonutil_string.hh.
+
+  On a syntax or type error the document is parsed again by
+  BasicJsonType::parse() and get<T>() so that the same exception as the
+  sequential path is thrown. Other exceptions such as std::bad_alloc are
+  passed through. If a thread cannot be started, the threads already
+  running decode the rest. Link with -pthread.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "jsonutil.hh"
+#include "jsonutil_string.hh"
+
+namespace yos {
+
+// vectors smaller than this are decoded by one BasicJsonType::parse()
+constexpr size_t parallel_min_bytes = 1 << 20;
+
+// ------------------------------
+// element_scanner : finds elements of an array or members of an object
+class element_scanner {
+public:
+  /*
+    p points at the first byte after '[' or '{'. Calls f(begin, end) for
+    each element until the closing bracket. f returns false to stop.
+    Returns the closing bracket or the ',' after the last element given to
+    f, or nullptr if end is reached first. Elements are not validated.
+  */
+  template <typename F>
+  static const char* scan(const char* p, const char* end, F&& f) {
+    const char* begin          = p;
+    int         depth          = 0;
+    bool        any            = false;
+    bool        prev_escaped   = false;
+    uint64_t    prev_in_string = 0;
+    for (const char* block = p; block < end; block += 64) {
+      masks m = classify(block, end);
+      m.quote &= ~escaped(m.backslash, prev_escaped);
+      const uint64_t in_string = prefix_xor(m.quote) ^ prev_in_string;
+      prev_in_string = 0 - (in_string >> 63);
+      uint64_t structural = (m.open | m.close | m.comma) & ~in_string;
+      while (structural) {
+        const int      i   = string_kernel::ctz(structural);
+        const uint64_t bit = uint64_t(1) << i;
+        const char*    q   = block + i;
+        structural &= structural - 1;
+        if (m.open & bit) {
+          ++depth;
+        } else if (m.close & bit) {
+          if (depth-- != 0) continue;
+          if (any || !blank(begin, q)) f(begin, q);
+          return q;
+        } else if (depth == 0) {
+          any = true;
+          if (!f(begin, q)) return q;
+          begin = q + 1;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  static bool blank(const char* b, const char* e) {
+    for (; b != e; ++b) {
+      if (*b != ' ' && *b != '\t' && *b != '\n' && *b != '\r') return false;
+    }
+    return true;
+  }
+
+  static const char* skip_blank(const char* b, const char* e) {
+    while (b != e && blank(b, b + 1)) ++b;
+    return b;
+  }
+
+private:
+  struct masks {
+    uint64_t quote, backslash, open, close, comma;
+  };
+
+  static masks classify(const char* block, const char* end) {
+    char pad[64];
+    if (end - block < 64) {  // last block
+      std::memset(pad, ' ', sizeof(pad));
+      std::memcpy(pad, block, end - block);
+      block = pad;
+    }
+    masks m{0, 0, 0, 0, 0};
+#ifdef __SSE2__
+    using string_kernel::eq_mask_sse2;
+    const __m128i lower = _mm_set1_epi8(0x20);
+    for (int k = 0; k != 4; ++k) {
+      const __m128i x =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * k));
+      const __m128i xl = _mm_or_si128(x, lower);
+      const int     s  = 16 * k;
+      m.quote |= uint64_t(eq_mask_sse2(x, '"')) << s;
+      m.backslash |= uint64_t(eq_mask_sse2(x, '\\')) << s;
+      m.open |= uint64_t(eq_mask_sse2(xl, '{')) << s;   // '[' | 0x20 == '{'
+      m.close |= uint64_t(eq_mask_sse2(xl, '}')) << s;  // ']' | 0x20 == '}'
+      m.comma |= uint64_t(eq_mask_sse2(x, ',')) << s;
+    }
+#else
+    for (int i = 0; i != 64; ++i) {
+      const uint64_t bit = uint64_t(1) << i;
+      switch (block[i]) {
+        case '"': m.quote |= bit; break;
+        case '\\': m.backslash |= bit; break;
+        case '[':
+        case '{': m.open |= bit; break;
+        case ']':
+        case '}': m.close |= bit; break;
+        case ',': m.comma |= bit; break;
+      }
+    }
+#endif
+    return m;
+  }
+
+  // characters preceded by an odd number of backslashes
+  static uint64_t escaped(uint64_t backslash, bool& prev_escaped) {
+    uint64_t e    = prev_escaped ? 1 : 0;
+    prev_escaped  = false;
+    backslash    &= ~e;
+    while (backslash) {
+      const int i = string_kernel::ctz(backslash);
+      backslash &= backslash - 1;
+      if (i == 63) {
+        prev_escaped = true;
+      } else {
+        e |= uint64_t(1) << (i + 1);
+        backslash &= ~(uint64_t(1) << (i + 1));
+      }
+    }
+    return e;
+  }
+
+  // bit i is xor of bits 0..i, i.e. set between opening and closing quotes
+  static uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+  }
+};
+
+// ------------------------------
+// parallel_parse
+struct parallel_parse_failed {};
+
+template <typename BasicJsonType>
+struct parallel_decoder {
+  unsigned threads;
+
+  static void require(bool cond) {
+    if (!cond) throw parallel_parse_failed();
+  }
+
+  template <typename T>
+  void value(const char* b, const char* e, T& v) {
+    value_(b, e, v, priority<2>());
+  }
+
+  // elements of large vectors in parallel
+  template <typename E, typename A>
+  auto value_(const char* b, const char* e, std::vector<E, A>& v, priority<2>)
+      -> typename std::enable_if<!std::is_same<E, bool>::value>::type {
+    if (size_t(e - b) < parallel_min_bytes) return value_(b, e, v, priority<0>());
+    b = element_scanner::skip_blank(b, e);
+    require(b != e && *b == '[');
+
+    // count elements and remember the start of every chunk-th element
+    constexpr size_t         chunk = 1024;
+    std::vector<const char*> starts;
+    size_t                   count = 0;
+    const char*              close = element_scanner::scan(
+        b + 1, e, [&](const char* eb, const char*) {
+          if (count++ % chunk == 0) starts.push_back(eb);
+          return true;
+        });
+    require(close && *close == ']' &&
+            element_scanner::blank(close + 1, e));
+
+    v.resize(count);
+    std::atomic<size_t> next(0);
+    std::atomic<bool>   failed(false);
+    std::exception_ptr  error;
+    auto                work = [&]() {
+      try {
+        for (size_t t; !failed && (t = next++) < starts.size();) {
+          size_t i = t * chunk;
+          element_scanner::scan(starts[t], close + 1,
+                                [&](const char* eb, const char* ee) {
+                                  v[i] = BasicJsonType::parse(eb, ee)
+                                             .template get<E>();
+                                  return ++i % chunk != 0;
+                                });
+        }
+      } catch (...) {
+        if (!failed.exchange(true)) error = std::current_exception();
+      }
+    };
+    const unsigned n = static_cast<unsigned>(
+        std::min<size_t>(threads, starts.size()));
+    std::vector<std::thread> pool;
+    pool.reserve(n);
+    try {
+      for (unsigned k = 1; k < n; ++k) pool.emplace_back(work);
+    } catch (const std::system_error&) {
+      // out of threads: the ones already started and this one do the rest
+    }
+    work();
+    for (auto& t : pool) t.join();
+    if (error) std::rethrow_exception(error);
+  }
+
+  // JSON_MEMBER struct member by member
+  template <typename T>
+  auto value_(const char* b, const char* e, T& v, priority<1>)
+      -> decltype(T::members_size_(), void()) {
+    b = element_scanner::skip_blank(b, e);
+    require(b != e && (*b == '{' || *b == '['));
+    std::vector<bool> seen(T::members_size_(), false);
+    const char*       close = nullptr;
+    if (*b == '[') {
+      size_t idx = 0;
+      close      = element_scanner::scan(
+          b + 1, e, [&](const char* eb, const char* ee) {
+            member(v, idx, eb, ee, seen);
+            return ++idx < T::members_size_();
+          });
+      // extra elements are validated and ignored like from_json()
+      if (close && *close == ',') {
+        close = element_scanner::scan(
+            close + 1, e, [](const char* eb, const char* ee) {
+              require(BasicJsonType::accept(eb, ee));
+              return true;
+            });
+      }
+      require(close && *close == ']');
+    } else {
+      close = element_scanner::scan(
+          b + 1, e, [&](const char* eb, const char* ee) {
+            const char* vb   = eb;
+            const auto  name = decode_key(split_member(vb, ee));
+            size_t      pos  = 0;
+            for (; pos != T::members_size_(); ++pos) {
+              const auto m = T::template membername_<
+                  std::pair<const char*, size_t>>(pos);
+              if (name.compare(0, std::string::npos, m.first, m.second) == 0)
+                break;
+            }
+            if (pos != T::members_size_())
+              member(v, pos, vb, ee, seen);
+            else  // unknown member
+              require(BasicJsonType::accept(vb, ee));
+            return true;
+          });
+      require(close && *close == '}');
+    }
+    require(element_scanner::blank(close + 1, e));
+    require(std::find(seen.begin(), seen.end(), false) == seen.end());
+  }
+
+  template <typename T>
+  void value_(const char* b, const char* e, T& v, priority<0>) {
+    v = BasicJsonType::parse(b, e).template get<T>();
+  }
+
+  template <typename T>
+  void member(T& v, size_t idx, const char* b, const char* e,
+              std::vector<bool>& seen) {
+    v.visit_members_([&](size_t pos, auto& m) {
+      if (pos != idx) return;
+      value(b, e, m);
+      seen[pos] = true;
+    });
+  }
+
+  // splits "key" : value. returns the key with quotes, b is set to value.
+  static std::pair<const char*, const char*> split_member(const char*& b,
+                                                          const char*  e) {
+    const char* k = element_scanner::skip_blank(b, e);
+    require(k != e && *k == '"');
+    const auto& sk = string_kernels::best();
+    const char* q  = k + 1;
+    for (;;) {
+      q += sk.escape_scan(q, e - q);
+      require(q != e && (*q == '"' || *q == '\\'));  // no control character
+      if (*q == '"') break;
+      q += 2;
+      require(q < e);
+    }
+    const char* colon = element_scanner::skip_blank(q + 1, e);
+    require(colon != e && *colon == ':');
+    b = colon + 1;
+    return {k, q + 1};
+  }
+
+  static std::string decode_key(std::pair<const char*, const char*> key) {
+    const char*  s = key.first + 1;
+    const size_t n = key.second - key.first - 2;
+    if (std::find(s, s + n, '\\') == s + n) {
+      require(string_kernels::best().validate_utf8(s, n));
+      return std::string(s, n);
+    }
+    return BasicJsonType::parse(key.first, key.second)
+        .template get<std::string>();
+  }
+};
+
+template <typename BasicJsonType = nlohmann::json, typename T>
+void parallel_parse(const char* s, size_t n, T& v, unsigned threads = 0) {
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  try {
+    parallel_decoder<BasicJsonType>{threads}.value(s, s + n, v);
+  } catch (const parallel_parse_failed&) {
+    // report the error in the same way as the sequential path
+    v = BasicJsonType::parse(s, s + n).template get<T>();
+  } catch (const typename BasicJsonType::exception&) {
+    v = BasicJsonType::parse(s, s + n).template get<T>();
+  }
+}
+
+template <typename T, typename BasicJsonType = nlohmann::json>
+T parallel_parse(const char* s, size_t n, unsigned threads = 0) {
+  T v;
+  parallel_parse<BasicJsonType>(s, n, v, threads);
+  return v;
+}
+}
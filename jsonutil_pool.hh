@@ -0,0 +1,219 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  json type sharing object keys among documents.
+
+    yos::pooled_map_json
+      Same as yos::map_json except that object keys are yos::pooled_key, a
+      handle to a string interned in yos::key_pool. Objects with the same
+      member names share one copy of each name.
+
+    yos::pooled_key
+      Converts implicitly to const std::string&, so dump(), at(), find(),
+      items() and iterator key() work as with std::string keys. Lookup by
+      std::string or const char* does not intern the argument.
+
+    yos::key_pool::instance()
+      Process wide, thread safe pool. Interned strings live until the end
+      of the process.
+
+    void key_pool::seed<T>()
+      Interns member names of T embedded by YOS_EMBED_NAMES().
+
+    void key_pool::limit(size_t bytes)
+      Total length of strings the pool interns besides seeded names.
+      Defaults to 1 MiB. Once the pool is full, keys not in the pool are
+      stored in pooled_key itself and are not shared, so parsing documents
+      with arbitrary keys does not grow the pool without bound.
+
+  Each thread caches recently interned strings, so interning known names
+  does not take the lock.
+*/
+
+#include <array>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include "jsonutil.hh"
+
+namespace yos {
+
+class key_pool {
+public:
+  static key_pool& instance() {
+    static key_pool pool;
+    return pool;
+  }
+
+  // returns nullptr if s is not in the pool and the pool is full
+  const std::string* intern(const char* s, size_t n) {
+    return intern(s, n, false);
+  }
+
+  template <typename T>
+  void seed() {
+    for (size_t i = 0; i != T::members_size_(); ++i) {
+      const auto name =
+          T::template membername_<std::pair<const char*, size_t>>(i);
+      intern(name.first, name.second, true);
+    }
+  }
+
+  void limit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    limit_ = bytes;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return pool_.size();
+  }
+
+private:
+  key_pool() = default;
+
+  const std::string* intern(const char* s, size_t n, bool seed) {
+    thread_local std::array<const std::string*, 64> cache{};
+    const std::string*& c = cache[hash(s, n) % cache.size()];
+    if (c && c->size() == n && std::memcmp(c->data(), s, n) == 0) return c;
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::string key(s, n);
+    auto        itr = pool_.find(key);
+    if (itr == pool_.end()) {
+      if (!seed && bytes_ + n > limit_) return nullptr;
+      if (!seed) bytes_ += n;
+      itr = pool_.insert(std::move(key)).first;
+    }
+    c = &*itr;
+    return c;
+  }
+
+  // FNV-1a
+  static size_t hash(const char* s, size_t n) {
+    size_t h = 2166136261u;
+    for (size_t i = 0; i != n; ++i) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+  }
+
+  mutable std::mutex mtx_;
+  // node based container. addresses of elements are stable.
+  std::unordered_set<std::string> pool_;
+  size_t                          bytes_ = 0;        // unseeded strings
+  size_t                          limit_ = 1 << 20;  // of bytes_
+};
+
+class pooled_key;
+
+// string types to compare with pooled_key
+template <typename S>
+using enable_if_key_string =
+    std::enable_if<!std::is_same<S, pooled_key>::value &&
+                   std::is_constructible<std::string, const S&>::value>;
+
+class pooled_key {
+public:
+  pooled_key() : pooled_key("", 0) {}
+  pooled_key(const char* s, size_t n)
+      : s_(key_pool::instance().intern(s, n)), owned_(!s_) {
+    if (owned_) s_ = new std::string(s, n);
+  }
+  pooled_key(const char* s) : pooled_key(s, std::strlen(s)) {}
+  pooled_key(const std::string& s) : pooled_key(s.data(), s.size()) {}
+  pooled_key(const pooled_key& k)
+      : s_(k.owned_ ? new std::string(*k.s_) : k.s_), owned_(k.owned_) {}
+  pooled_key(pooled_key&& k) noexcept : s_(k.s_), owned_(k.owned_) {
+    k.owned_ = false;
+  }
+  pooled_key& operator=(pooled_key k) noexcept {
+    std::swap(s_, k.s_);
+    std::swap(owned_, k.owned_);
+    return *this;
+  }
+  ~pooled_key() {
+    if (owned_) delete s_;
+  }
+
+  operator const std::string&() const { return *s_; }
+  const std::string& str() const { return *s_; }
+  const char*        c_str() const { return s_->c_str(); }
+  const char*        data() const { return s_->data(); }
+  size_t             size() const { return s_->size(); }
+
+  friend bool operator==(const pooled_key& a, const pooled_key& b) {
+    return a.s_ == b.s_ || ((a.owned_ || b.owned_) && *a.s_ == *b.s_);
+  }
+  friend bool operator!=(const pooled_key& a, const pooled_key& b) {
+    return !(a == b);
+  }
+  friend bool operator<(const pooled_key& a, const pooled_key& b) {
+    return a.s_ != b.s_ && *a.s_ < *b.s_;
+  }
+  // comparison with strings without interning
+  template <typename S, typename = typename enable_if_key_string<S>::type>
+  friend bool operator==(const pooled_key& a, const S& b) {
+    return *a.s_ == b;
+  }
+  template <typename S, typename = typename enable_if_key_string<S>::type>
+  friend bool operator==(const S& a, const pooled_key& b) {
+    return a == *b.s_;
+  }
+  template <typename S, typename = typename enable_if_key_string<S>::type>
+  friend bool operator!=(const pooled_key& a, const S& b) {
+    return *a.s_ != b;
+  }
+  template <typename S, typename = typename enable_if_key_string<S>::type>
+  friend bool operator!=(const S& a, const pooled_key& b) {
+    return a != *b.s_;
+  }
+  friend std::ostream& operator<<(std::ostream& os, const pooled_key& k) {
+    return os << *k.s_;
+  }
+
+private:
+  const std::string* s_;
+  bool               owned_;  // not in the pool
+};
+
+// transparent comparator. keys are ordered as std::string.
+struct pooled_key_less {
+  using is_transparent = void;
+  bool operator()(const pooled_key& a, const pooled_key& b) const {
+    return a < b;
+  }
+  template <typename S, typename = typename enable_if_key_string<S>::type>
+  bool operator()(const pooled_key& a, const S& b) const {
+    return a.str() < b;
+  }
+  template <typename S, typename = typename enable_if_key_string<S>::type>
+  bool operator()(const S& a, const pooled_key& b) const {
+    return a < b.str();
+  }
+};
+
+// ObjectType for nlohmann::basic_json. comparator and allocator given by
+// basic_json are replaced.
+template <typename Key, typename T, typename... Ignored>
+using pooled_map = std::map<pooled_key, T, pooled_key_less>;
+
+// ------------------------------
+// pooled_map_json : map_json with keys in yos::key_pool
+using pooled_map_json =
+    nlohmann::basic_json<pooled_map, std::vector, std::string, bool,
+                         std::int64_t, std::uint64_t, double, std::allocator,
+                         map_adl_serializer>;
+}
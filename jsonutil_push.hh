@@ -0,0 +1,729 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  Push style incremental parser for structs marked with JSON_MEMBER().
+
+    yos::push_parser<T, BasicJsonType = nlohmann::json>
+
+  Bytes are given to feed() in arbitrary fragments as they arrive. Partial
+  tokens and nesting are kept between calls. Values are decoded into T as
+  they arrive, without building BasicJsonType: numbers, bool and strings
+  are converted directly, std::vector and std::array are filled element by
+  element and members of JSON_MEMBER structs are assigned one by one.
+  Members of other types are collected as BasicJsonType and converted by
+  get<>() when complete. Strings are scanned and checked for UTF-8 by the
+  kernels of jsonutil_string.hh.
+
+    size_t feed(const char* s, size_t n)
+      Consumes bytes up to the end of current message and returns number of
+      bytes consumed. Remaining n-(returned value) bytes belong to the next
+      message.
+
+    bool done()
+      Returns true when a message has been completed.
+
+    T& get()
+      Returns the decoded object.
+
+    void reset()
+      Prepares for the next message.
+
+  Both object form and array form (yos::array_json) of T and of nested
+  structs are accepted. Unknown members are validated and skipped.
+  Malformed input, values of wrong type and missing members are reported by
+  push_parse_error.
+*/
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <clocale>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "jsonutil.hh"
+#include "jsonutil_string.hh"
+
+namespace yos {
+
+class push_parse_error : public std::runtime_error {
+public:
+  push_parse_error(const std::string& what, size_t pos)
+      : std::runtime_error(what + " at byte " + std::to_string(pos)),
+        byte(pos) {}
+  const size_t byte;  // offset from the beginning of the message
+};
+
+template <typename T, typename BasicJsonType = nlohmann::json>
+class push_parser {
+public:
+  push_parser() : kernels_(&string_kernels::best()) { reset(); }
+
+  void reset() {
+    obj_    = T();
+    depth_  = 0;
+    state_  = state::value;
+    escape_ = false;
+    key_    = false;
+    pos_    = 0;
+    token_.clear();
+  }
+
+  size_t feed(const char* s, size_t n) {
+    size_t i = 0;
+    while (i != n && state_ != state::done) {
+      const size_t c = step(s + i, n - i);
+      i += c;
+      pos_ += c;
+    }
+    return i;
+  }
+
+  bool     done() const { return state_ == state::done; }
+  T&       get() { return obj_; }
+  const T& get() const { return obj_; }
+
+private:
+  enum class state {
+    value,         // expecting value
+    value_or_end,  // expecting value or ']'
+    key,           // expecting '"'
+    key_or_end,    // expecting '"' or '}'
+    colon,         // expecting ':'
+    comma_or_end,  // expecting ',' or closing bracket
+    string,        // in string token
+    number,        // in number token
+    literal,       // in true/false/null
+    done
+  };
+  enum class kind { string, number, true_, false_, null };
+
+  //-------------------------------------------------- sinks
+  /*
+    A sink receives one value. ops of the type of the target decides what
+    to do with scalars and with children of arrays and objects.
+  */
+  struct frame;
+  struct ops;
+  struct sink {
+    const ops* o;
+    void*      t;
+  };
+  struct ops {
+    void (*scalar)(void* t, push_parser& p);  // p.kind_, p.token_
+    void (*open)(void* t, push_parser& p, frame& f);
+    sink (*child)(void* t, push_parser& p, frame& f);  // f.key or f.index
+    void (*close)(void* t, push_parser& p, frame& f);
+  };
+  struct frame {
+    sink              target;
+    bool              is_object;
+    std::string       key;
+    size_t            index;
+    std::vector<bool> seen;  // members of structs
+    BasicJsonType     dom;   // values collected for get<>()
+  };
+
+  // defaults: values of wrong type
+  struct no_scalar {
+    static void scalar(void*, push_parser& p) { p.fail("unexpected value"); }
+  };
+  struct no_container {
+    static void open(void*, push_parser& p, frame&) {
+      p.fail("unexpected array or object");
+    }
+    static sink child(void*, push_parser& p, frame&) { return skip(); }
+    static void close(void*, push_parser&, frame&) {}
+  };
+
+  // unknown members
+  struct skip_h {
+    static void scalar(void*, push_parser&) {}
+    static void open(void*, push_parser&, frame&) {}
+    static sink child(void*, push_parser&, frame&) { return skip(); }
+    static void close(void*, push_parser&, frame&) {}
+  };
+
+  template <typename M>
+  struct number_h : no_container {
+    static void scalar(void* t, push_parser& p) {
+      M& m = *static_cast<M*>(t);
+      switch (p.kind_) {
+        case kind::number: {
+          if (std::is_floating_point<M>::value || !p.is_integer_token()) {
+            m = static_cast<M>(p.to_double());
+          } else if (p.token_[0] == '-') {
+            errno                = 0;
+            const long long v    = std::strtoll(p.token_.c_str(), nullptr, 10);
+            m = errno ? static_cast<M>(p.to_double()) : static_cast<M>(v);
+          } else {
+            errno = 0;
+            const unsigned long long v =
+                std::strtoull(p.token_.c_str(), nullptr, 10);
+            m = errno ? static_cast<M>(p.to_double()) : static_cast<M>(v);
+          }
+          return;
+        }
+        case kind::true_:
+        case kind::false_:  // converted like get<M>()
+          m = static_cast<M>(p.kind_ == kind::true_);
+          return;
+        default:
+          p.fail("expected number");
+      }
+    }
+  };
+
+  struct bool_h : no_container {
+    static void scalar(void* t, push_parser& p) {
+      if (p.kind_ != kind::true_ && p.kind_ != kind::false_)
+        p.fail("expected true or false");
+      *static_cast<bool*>(t) = p.kind_ == kind::true_;
+    }
+  };
+
+  struct string_h : no_container {
+    static void scalar(void* t, push_parser& p) {
+      if (p.kind_ != kind::string) p.fail("expected string");
+      *static_cast<std::string*>(t) = p.token_;
+    }
+  };
+
+  template <typename M>
+  struct enum_h : no_container {
+    static void scalar(void* t, push_parser& p) {
+      if (p.kind_ != kind::string ||
+          !enum_from_name(p.token_.data(), p.token_.size(),
+                          *static_cast<M*>(t)))
+        p.fail("expected name of enumerator");
+    }
+  };
+
+  template <typename V>
+  struct vector_h : no_scalar {
+    static void open(void* t, push_parser& p, frame& f) {
+      if (f.is_object) p.fail("expected array");
+      static_cast<V*>(t)->clear();
+    }
+    static sink child(void* t, push_parser&, frame&) {
+      V& v = *static_cast<V*>(t);
+      v.emplace_back();
+      return make_sink(v.back());
+    }
+    static void close(void*, push_parser&, frame&) {}
+  };
+
+  template <typename A>
+  struct array_h : no_scalar {
+    static void open(void*, push_parser& p, frame& f) {
+      if (f.is_object) p.fail("expected array");
+    }
+    static sink child(void* t, push_parser&, frame& f) {
+      A& a = *static_cast<A*>(t);
+      return f.index < a.size() ? make_sink(a[f.index]) : skip();
+    }
+    static void close(void* t, push_parser& p, frame& f) {
+      if (f.index < static_cast<A*>(t)->size()) p.fail("too few elements");
+    }
+  };
+
+  template <typename M>
+  struct struct_h : no_scalar {
+    static void open(void*, push_parser&, frame& f) {
+      f.seen.assign(M::members_size_(), false);
+    }
+    static sink child(void* t, push_parser&, frame& f) {
+      const size_t idx = f.is_object ? position(f.key) : f.index;
+      if (idx >= M::members_size_()) return skip();
+      f.seen[idx] = true;
+      return member_sinks(std::make_index_sequence<M::members_size_()>())[idx](
+          *static_cast<M*>(t));
+    }
+    // position of member named key, or members_size_() if unknown
+    static size_t position(const std::string& key) {
+      using token        = std::pair<const char*, size_t>;
+      constexpr size_t n = M::members_size_();
+      auto less = [](const token& a, const token& b) {
+        const int c =
+            std::memcmp(a.first, b.first, std::min(a.second, b.second));
+        return c < 0 || (c == 0 && a.second < b.second);
+      };
+      // member positions in the order of names
+      static const std::array<size_t, n> order = [&less] {
+        std::array<size_t, n> o;
+        for (size_t i = 0; i != n; ++i) o[i] = i;
+        std::sort(o.begin(), o.end(), [&less](size_t a, size_t b) {
+          return less(M::template membername_<token>(a),
+                      M::template membername_<token>(b));
+        });
+        return o;
+      }();
+      const token k(key.data(), key.size());
+      const auto  itr = std::lower_bound(
+          order.begin(), order.end(), k, [&less](size_t pos, const token& k) {
+            return less(M::template membername_<token>(pos), k);
+          });
+      if (itr == order.end() || less(k, M::template membername_<token>(*itr)))
+        return n;
+      return *itr;
+    }
+    template <size_t I>
+    static sink member_sink(M& m) {
+      return make_sink(std::get<I>(m.members_tie_()));
+    }
+    // member_sink() of each member, indexed by position
+    template <size_t... I>
+    static const std::array<sink (*)(M&), sizeof...(I)>& member_sinks(
+        std::index_sequence<I...>) {
+      static const std::array<sink (*)(M&), sizeof...(I)> f{
+          {&member_sink<I>...}};
+      return f;
+    }
+    static void close(void*, push_parser& p, frame& f) {
+      for (size_t i = 0; i != f.seen.size(); ++i) {
+        if (!f.seen[i])
+          p.fail("missing member '" + M::membername_(static_cast<int>(i)) +
+                 "'");
+      }
+    }
+  };
+
+  // BasicJsonType node inside a value collected by fallback_h
+  struct dom_h {
+    static void scalar(void* t, push_parser& p) {
+      *static_cast<BasicJsonType*>(t) = p.scalar_json();
+    }
+    static void open(void* t, push_parser&, frame& f) {
+      *static_cast<BasicJsonType*>(t) =
+          f.is_object ? BasicJsonType::object() : BasicJsonType::array();
+    }
+    static sink child(void* t, push_parser&, frame& f) {
+      BasicJsonType& j = *static_cast<BasicJsonType*>(t);
+      if (f.is_object) return sink{&table<dom_h>(), &j[f.key]};
+      j.push_back(nullptr);
+      return sink{&table<dom_h>(), &j.back()};
+    }
+    static void close(void*, push_parser&, frame&) {}
+  };
+
+  // other types: collected as BasicJsonType and converted by get<>()
+  template <typename M>
+  struct fallback_h {
+    static void scalar(void* t, push_parser& p) {
+      convert(t, p, p.scalar_json());
+    }
+    static void open(void*, push_parser& p, frame& f) {
+      dom_h::open(&f.dom, p, f);
+    }
+    static sink child(void*, push_parser& p, frame& f) {
+      return dom_h::child(&f.dom, p, f);
+    }
+    static void close(void* t, push_parser& p, frame& f) {
+      convert(t, p, f.dom);
+      f.dom = nullptr;
+    }
+    static void convert(void* t, push_parser& p, const BasicJsonType& j) {
+      try {
+        *static_cast<M*>(t) = j.template get<M>();
+      } catch (typename BasicJsonType::exception& e) {
+        p.fail(e.what());
+      }
+    }
+  };
+
+  template <typename H>
+  static const ops& table() {
+    static const ops o{&H::scalar, &H::open, &H::child, &H::close};
+    return o;
+  }
+
+  static sink skip() { return sink{&table<skip_h>(), nullptr}; }
+
+  // handler for type M (declarations for decltype only)
+  template <typename M>
+  static auto handler_(M*, priority<4>)
+      -> decltype(M::members_size_(), struct_h<M>());
+  template <typename M>
+  static auto handler_(M*, priority<3>) ->
+      typename std::enable_if<is_json_enum<M>::value, enum_h<M>>::type;
+  template <typename M>
+  static auto handler_(M*, priority<2>) ->
+      typename std::enable_if<std::is_arithmetic<M>::value &&
+                                  !std::is_same<M, bool>::value,
+                              number_h<M>>::type;
+  template <typename M>
+  static auto handler_(M*, priority<2>) ->
+      typename std::enable_if<std::is_same<M, bool>::value, bool_h>::type;
+  static string_h handler_(std::string*, priority<2>);
+  template <typename E, typename A>
+  static auto handler_(std::vector<E, A>*, priority<2>) ->
+      typename std::enable_if<!std::is_same<E, bool>::value &&
+                                  std::is_default_constructible<E>::value,
+                              vector_h<std::vector<E, A>>>::type;
+  template <typename E, size_t N>
+  static array_h<std::array<E, N>> handler_(std::array<E, N>*, priority<2>);
+  static dom_h handler_(BasicJsonType*, priority<1>);
+  template <typename M>
+  static fallback_h<M> handler_(M*, priority<0>);
+
+  template <typename M>
+  static sink make_sink(M& m) {
+    using H = decltype(handler_(static_cast<M*>(nullptr), priority<4>()));
+    return sink{&table<H>(), &m};
+  }
+
+  //-------------------------------------------------- scalars
+  bool is_integer_token() const {
+    return token_.find_first_of(".eE") == std::string::npos;
+  }
+
+  double to_double() const {
+    const char dp = *std::localeconv()->decimal_point;
+    if (dp == '.') return std::strtod(token_.c_str(), nullptr);
+    std::string s = token_;
+    for (auto& c : s) {
+      if (c == '.') c = dp;
+    }
+    return std::strtod(s.c_str(), nullptr);
+  }
+
+  // number grammar of RFC 8259
+  static bool valid_number(const std::string& s) {
+    size_t i = 0;
+    auto digits = [&]() {
+      const size_t b = i;
+      while (i != s.size() && s[i] >= '0' && s[i] <= '9') ++i;
+      return i != b;
+    };
+    if (i != s.size() && s[i] == '-') ++i;
+    if (i != s.size() && s[i] == '0')
+      ++i;
+    else if (!digits())
+      return false;
+    if (i != s.size() && s[i] == '.' && (++i, !digits())) return false;
+    if (i != s.size() && (s[i] == 'e' || s[i] == 'E')) {
+      ++i;
+      if (i != s.size() && (s[i] == '+' || s[i] == '-')) ++i;
+      if (!digits()) return false;
+    }
+    return i == s.size();
+  }
+
+  BasicJsonType scalar_json() const {
+    using I = typename BasicJsonType::number_integer_t;
+    using U = typename BasicJsonType::number_unsigned_t;
+    switch (kind_) {
+      case kind::string:
+        return BasicJsonType(token_);
+      case kind::true_:
+        return BasicJsonType(true);
+      case kind::false_:
+        return BasicJsonType(false);
+      case kind::null:
+        return BasicJsonType(nullptr);
+      default:
+        break;
+    }
+    if (is_integer_token()) {
+      errno = 0;
+      if (token_[0] == '-') {
+        const long long v = std::strtoll(token_.c_str(), nullptr, 10);
+        if (!errno) return BasicJsonType(static_cast<I>(v));
+      } else {
+        const unsigned long long v =
+            std::strtoull(token_.c_str(), nullptr, 10);
+        if (!errno) return BasicJsonType(static_cast<U>(v));
+      }
+    }
+    return BasicJsonType(to_double());
+  }
+
+  static int hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  unsigned read_u4(size_t& i) const {
+    if (i + 4 >= raw_.size()) fail("invalid \\u escape");
+    unsigned u = 0;
+    for (int k = 1; k <= 4; ++k) {
+      const int h = hex(raw_[i + k]);
+      if (h < 0) fail("invalid \\u escape");
+      u = u * 16 + h;
+    }
+    i += 4;
+    return u;
+  }
+
+  static void append_utf8(std::string& s, unsigned c) {
+    if (c < 0x80) {
+      s += static_cast<char>(c);
+    } else if (c < 0x800) {
+      s += static_cast<char>(0xC0 | (c >> 6));
+      s += static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+      s += static_cast<char>(0xE0 | (c >> 12));
+      s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      s += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+      s += static_cast<char>(0xF0 | (c >> 18));
+      s += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+      s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      s += static_cast<char>(0x80 | (c & 0x3F));
+    }
+  }
+
+  // decodes raw_ (string without quotes) into token_
+  void unescape() {
+    if (!kernels_->validate_utf8(raw_.data(), raw_.size()))
+      fail("invalid UTF-8 in string");
+    if (raw_.find('\\') == std::string::npos) {
+      token_.swap(raw_);
+      return;
+    }
+    token_.clear();
+    for (size_t i = 0; i != raw_.size(); ++i) {
+      const char c = raw_[i];
+      if (c != '\\') {
+        token_ += c;
+        continue;
+      }
+      switch (raw_[++i]) {
+        case '"': token_ += '"'; break;
+        case '\\': token_ += '\\'; break;
+        case '/': token_ += '/'; break;
+        case 'b': token_ += '\b'; break;
+        case 'f': token_ += '\f'; break;
+        case 'n': token_ += '\n'; break;
+        case 'r': token_ += '\r'; break;
+        case 't': token_ += '\t'; break;
+        case 'u': {
+          unsigned u = read_u4(i);
+          if (u >= 0xD800 && u <= 0xDBFF) {  // surrogate pair
+            if (i + 2 >= raw_.size() || raw_[i + 1] != '\\' ||
+                raw_[i + 2] != 'u')
+              fail("invalid surrogate pair");
+            i += 2;
+            const unsigned lo = read_u4(i);
+            if (lo < 0xDC00 || lo > 0xDFFF) fail("invalid surrogate pair");
+            u = 0x10000 + ((u - 0xD800) << 10) + (lo - 0xDC00);
+          } else if (u >= 0xDC00 && u <= 0xDFFF) {
+            fail("invalid surrogate pair");
+          }
+          append_utf8(token_, u);
+          break;
+        }
+        default:
+          fail("invalid escape");
+      }
+    }
+  }
+
+  //-------------------------------------------------- tokenizer
+  static bool is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+  }
+  static bool is_number(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+           c == 'e' || c == 'E';
+  }
+  static bool is_alpha(char c) { return c >= 'a' && c <= 'z'; }
+
+  [[noreturn]] void fail(const std::string& what) const {
+    throw push_parse_error(what, pos_);
+  }
+
+  // returns number of consumed bytes.
+  // 0 is returned when a token is terminated by the current char.
+  size_t step(const char* s, size_t n) {
+    const char c = *s;
+    switch (state_) {
+      case state::string:
+        return scan_string(s, n);
+      case state::number:
+        return scan_token(s, n, is_number);
+      case state::literal:
+        return scan_token(s, n, is_alpha);
+      default:
+        break;
+    }
+    if (is_ws(c)) return 1;
+    switch (state_) {
+      case state::value_or_end:
+        if (c == ']') return close(c);
+      // fall through
+      case state::value:
+        return begin_value(c);
+      case state::key_or_end:
+        if (c == '}') return close(c);
+      // fall through
+      case state::key:
+        if (c != '"') fail("expected object key");
+        key_ = true;
+        raw_.clear();
+        state_ = state::string;
+        return 1;
+      case state::colon:
+        if (c != ':') fail("expected ':'");
+        state_ = state::value;
+        return 1;
+      case state::comma_or_end:
+        if (c == ',') {
+          state_ = top().is_object ? state::key : state::value;
+          return 1;
+        }
+        if (c == '}' || c == ']') return close(c);
+        fail("expected ',' or closing bracket");
+      default:
+        break;
+    }
+    return 0;
+  }
+
+  frame& top() { return frames_[depth_ - 1]; }
+
+  size_t begin_value(char c) {
+    if (depth_ == 0) {
+      if (c != '{' && c != '[') fail("expected '{' or '['");
+      value_ = make_sink(obj_);
+    } else {
+      frame& f = top();
+      value_   = f.target.o->child(f.target.t, *this, f);
+    }
+    switch (c) {
+      case '{':
+      case '[': {
+        if (depth_ == frames_.size()) frames_.emplace_back();
+        frame& f    = frames_[depth_++];
+        f.target    = value_;
+        f.is_object = c == '{';
+        f.index     = 0;
+        f.target.o->open(f.target.t, *this, f);
+        state_ = f.is_object ? state::key_or_end : state::value_or_end;
+        return 1;
+      }
+      case '"':
+        key_ = false;
+        raw_.clear();
+        state_ = state::string;
+        return 1;
+      case 't':
+      case 'f':
+      case 'n':
+        state_ = state::literal;
+        break;
+      default:
+        if (c != '-' && !(c >= '0' && c <= '9')) fail("unexpected character");
+        state_ = state::number;
+        break;
+    }
+    token_.assign(1, c);
+    return 1;
+  }
+
+  size_t scan_string(const char* s, size_t n) {
+    for (size_t i = 0; i != n;) {
+      if (escape_) {
+        escape_ = false;
+        ++i;
+        continue;
+      }
+      i += kernels_->escape_scan(s + i, n - i);
+      if (i == n) break;
+      if (s[i] == '\\') {
+        escape_ = true;
+        ++i;
+      } else if (s[i] != '"') {
+        fail("control character in string");
+      } else {
+        raw_.append(s, i);
+        unescape();
+        if (key_) {
+          top().key = token_;
+          state_    = state::colon;
+        } else {
+          kind_ = kind::string;
+          emit();
+        }
+        return i + 1;
+      }
+    }
+    raw_.append(s, n);
+    return n;
+  }
+
+  size_t scan_token(const char* s, size_t n, bool (*accept)(char)) {
+    size_t i = 0;
+    while (i != n && accept(s[i])) ++i;
+    token_.append(s, i);
+    if (i == n) return i;
+    if (state_ == state::number) {
+      if (!valid_number(token_)) fail("invalid number");
+      kind_ = kind::number;
+    } else if (token_ == "true") {
+      kind_ = kind::true_;
+    } else if (token_ == "false") {
+      kind_ = kind::false_;
+    } else if (token_ == "null") {
+      kind_ = kind::null;
+    } else {
+      fail("invalid literal");
+    }
+    emit();
+    return i;
+  }
+
+  // scalar value completed
+  void emit() {
+    value_.o->scalar(value_.t, *this);
+    ++top().index;
+    state_ = state::comma_or_end;
+  }
+
+  size_t close(char c) {
+    frame& f = top();
+    if ((c == '}') != f.is_object) fail("mismatched bracket");
+    f.target.o->close(f.target.t, *this, f);
+    if (--depth_ == 0) {
+      state_ = state::done;
+      return 1;
+    }
+    ++top().index;
+    state_ = state::comma_or_end;
+    return 1;
+  }
+
+  T                  obj_;
+  std::vector<frame> frames_;  // frames_[0, depth_) are open
+  size_t             depth_;
+  sink               value_;  // target of the current scalar
+  std::string        raw_;    // partial string token
+  std::string        token_;  // number or literal token, decoded string
+  kind               kind_;
+  state              state_;
+  bool               escape_;
+  bool               key_;  // string token is an object key
+  size_t             pos_;
+
+  const string_kernels* kernels_;
+};
+}
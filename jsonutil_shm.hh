@@ -0,0 +1,244 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  Shared memory channel for structs marked with JSON_MEMBER().
+
+    yos::shm_channel<T>
+      Single producer / multiple consumer ring buffer in POSIX shared memory.
+      Records are stored in the compact positional form of
+      jsonutil_binary.hh and decoded directly into T. Every consumer sees
+      every record unless the producer overwrites it first. Neither side
+      blocks or makes system calls after the channel is opened.
+
+    static shm_channel create(name, slots = 256, slot_size = 4096)
+      Creates (or recreates) the channel for the producer.
+      A record must fit in slot_size bytes. slots must not be 0.
+
+    static shm_channel open(name)
+      Opens existing channel for a consumer. Fails if the channel was
+      created for a type with different members (schema_fingerprint<T>())
+      or if the segment is too small for the slots recorded in its header.
+
+    static void remove(name)
+      Removes the name of the channel. Opened channels stay valid.
+
+    bool write(const T& v)
+      Producer only. Returns false if v does not fit in a slot.
+
+    bool read(T& v)
+      Reads the next record. Returns false if there is no new record.
+      Records overwritten before they are read are counted by lost().
+
+    bool latest(T& v) const
+    BasicJsonType json() const
+      Reads the most recent record without moving the read position.
+      json() returns it as json (null if nothing was written) for debugging.
+      Gives up and returns false if the producer overwrites the record on
+      every one of latest_retries attempts.
+
+  Slots are guarded by sequence numbers (seqlock). A consumer copies a
+  record out and checks the sequence number again before decoding.
+  Link with -lrt on old glibc.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "jsonutil_binary.hh"
+
+namespace yos {
+
+template <typename T>
+class shm_channel {
+public:
+  static shm_channel create(const std::string& name, size_t slots = 256,
+                            size_t slot_size = 4096) {
+    if (slots == 0)
+      throw std::invalid_argument("shm_channel: " + name + " needs slots");
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) fail("shm_open");
+    const size_t stride = align(sizeof(slot_header) + slot_size);
+    const size_t length = align(sizeof(header)) + stride * slots;
+    if (ftruncate(fd, length) != 0) {
+      close(fd);
+      fail("ftruncate");
+    }
+    shm_channel ch(fd, length);
+    header*     h = ch.header_;
+    h->schema     = schema_fingerprint<T>();
+    h->slots      = slots;
+    h->slot_size  = slot_size;
+    h->stride     = stride;
+    h->head.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i != slots; ++i)
+      ch.slot(i)->seq.store(0, std::memory_order_relaxed);
+    h->magic.store(magic_number, std::memory_order_release);
+    return ch;
+  }
+
+  static shm_channel open(const std::string& name) {
+    const int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) fail("shm_open");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(header)) {
+      close(fd);
+      throw std::runtime_error("shm_channel: " + name + " is not a channel");
+    }
+    shm_channel ch(fd, st.st_size);
+    if (ch.header_->magic.load(std::memory_order_acquire) != magic_number)
+      throw std::runtime_error("shm_channel: " + name + " is not a channel");
+    if (ch.header_->schema != schema_fingerprint<T>())
+      throw std::runtime_error("shm_channel: schema mismatch on " + name);
+    if (!ch.fits(st.st_size))
+      throw std::runtime_error("shm_channel: " + name + " is truncated");
+    // records written before open() are not read
+    ch.next_ = ch.header_->head.load(std::memory_order_acquire);
+    return ch;
+  }
+
+  static void remove(const std::string& name) { shm_unlink(name.c_str()); }
+
+  shm_channel(shm_channel&& o)
+      : header_(o.header_), length_(o.length_), next_(o.next_),
+        lost_(o.lost_), buf_(std::move(o.buf_)) {
+    o.header_ = nullptr;
+  }
+  shm_channel(const shm_channel&) = delete;
+  shm_channel& operator=(const shm_channel&) = delete;
+  ~shm_channel() {
+    if (header_) munmap(header_, length_);
+  }
+
+  bool write(const T& v) {
+    header*        h = header_;
+    const uint64_t n = h->head.load(std::memory_order_relaxed);
+    slot_header*   s = slot(n % h->slots);
+    s->seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    const size_t size = pack(data(s), h->slot_size, v);
+    s->size           = size;
+    s->seq.store(2 * n + 2, std::memory_order_release);
+    if (size == 0) return false;
+    h->head.store(n + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool read(T& v) {
+    for (;;) {
+      const uint64_t head = header_->head.load(std::memory_order_acquire);
+      if (next_ == head) return false;
+      if (head - next_ > header_->slots) {
+        lost_ += head - next_ - header_->slots;
+        next_ = head - header_->slots;
+      }
+      const uint64_t n = next_++;
+      if (copy(n)) return unpack(buf_.data(), buf_.size(), v);
+      ++lost_;
+    }
+  }
+
+  static constexpr int latest_retries = 16;
+
+  bool latest(T& v) const {
+    for (int i = 0; i != latest_retries; ++i) {
+      const uint64_t head = header_->head.load(std::memory_order_acquire);
+      if (head == 0) return false;
+      if (copy(head - 1)) return unpack(buf_.data(), buf_.size(), v);
+    }
+    return false;
+  }
+
+  template <typename BasicJsonType = nlohmann::json>
+  BasicJsonType json() const {
+    T v;
+    if (!latest(v)) return BasicJsonType();
+    return v;
+  }
+
+  uint64_t lost() const { return lost_; }
+
+private:
+  static constexpr uint64_t magic_number = 0x6c6e6863736f7901ull;
+
+  struct header {
+    std::atomic<uint64_t> magic;
+    uint64_t              schema;
+    uint64_t              slots;
+    uint64_t              slot_size;
+    uint64_t              stride;
+    alignas(64) std::atomic<uint64_t> head;  // number of records written
+  };
+  struct slot_header {
+    std::atomic<uint64_t> seq;  // 2n+1 while writing n-th record, 2n+2 after
+    uint64_t              size;
+  };
+
+  static size_t align(size_t n) { return (n + 63) & ~size_t(63); }
+  static void   fail(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+
+  shm_channel(int fd, size_t length) : length_(length) {
+    void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) fail("mmap");
+    header_ = static_cast<header*>(p);
+  }
+
+  // slots described by the header lie within length bytes
+  bool fits(size_t length) const {
+    const header* h = header_;
+    if (h->slots == 0 || h->slot_size > length) return false;
+    if (h->stride < sizeof(slot_header) + h->slot_size) return false;
+    const size_t body = align(sizeof(header));
+    return length >= body && (length - body) / h->stride >= h->slots;
+  }
+
+  slot_header* slot(size_t i) const {
+    return reinterpret_cast<slot_header*>(reinterpret_cast<char*>(header_) +
+                                          align(sizeof(header)) +
+                                          i * header_->stride);
+  }
+  static char* data(slot_header* s) {
+    return reinterpret_cast<char*>(s) + sizeof(slot_header);
+  }
+
+  // copies n-th record to buf_. false if it has been overwritten.
+  bool copy(uint64_t n) const {
+    slot_header*   s   = slot(n % header_->slots);
+    const uint64_t seq = s->seq.load(std::memory_order_acquire);
+    if (seq != 2 * n + 2) return false;
+    const size_t size = s->size;
+    if (size > header_->slot_size) return false;
+    buf_.assign(data(s), data(s) + size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s->seq.load(std::memory_order_relaxed) == seq;
+  }
+
+  header*                   header_;
+  size_t                    length_;
+  uint64_t                  next_ = 0;
+  uint64_t                  lost_ = 0;
+  mutable std::vector<char> buf_;
+};
+}
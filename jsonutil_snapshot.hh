@@ -0,0 +1,473 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  Memory mappable snapshot of structs marked with JSON_MEMBER().
+
+  Writing API
+    void write_snapshot(const T& v, const std::string& path)
+      Writes v to path. The file is written to path.tmp, synced and renamed,
+      so path is replaced atomically. path.tmp is removed on failure.
+
+  Reading API
+    yos::snapshot<T> snap(path)
+      Maps the file read-only. Throws if the file was written for a type
+      with different members (schema_fingerprint<T>()).
+
+    snapshot_ref<T> snapshot<T>::root()
+      Read-only view of the stored T. Members are accessed by member
+      pointers without parsing or allocation.
+
+        yos::snapshot<Points> snap("points.snap");
+        auto   pts = snap.root()[&Points::pts];   // snapshot_array<Point>
+        double x   = pts[3][&Point::x];
+        auto   s   = snap.root()[&Points::name];  // snapshot_string
+
+      Member types are exposed as
+        arithmetic, enum      value
+        std::string           snapshot_string (data(), size(), str())
+        std::vector<E>        snapshot_array<E> (size(), operator[])
+        std::array<E, N>      snapshot_array<E>
+        JSON_MEMBER struct    snapshot_ref<S>
+
+    T snapshot_ref<T>::load()
+      Copies the view into T.
+
+  Layout
+    Each struct is a record of its members in order without padding.
+    Strings and vectors are 16 bytes of {int64_t offset relative to the
+    field, uint64_t count} pointing at their elements elsewhere in the
+    file. Values are in the native byte order of the host.
+
+    Every offset and count is checked against the mapped file when it is
+    followed, and a reference out of the file throws std::runtime_error.
+    snapshot_array::operator[] throws std::out_of_range for an index past
+    size().
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "jsonutil_binary.hh"
+
+namespace yos {
+
+template <typename T, typename = void>
+struct has_members_ : std::false_type {};
+template <typename T>
+struct has_members_<T, decltype(T::members_size_(), void())>
+    : std::true_type {};
+
+template <typename T>
+size_t flat_size();
+
+// member offsets of struct T in a record
+template <typename T>
+class snapshot_layout {
+public:
+  static const snapshot_layout& get() {
+    static const snapshot_layout l;
+    return l;
+  }
+
+  // record offset of i-th member
+  size_t offset(size_t i) const { return offsets_[i]; }
+  // record offset of the member pointed by m
+  template <typename M>
+  size_t offset(M T::*m) const {
+    const char* p = reinterpret_cast<const char*>(&(obj_.*m));
+    for (size_t i = 0; i != addrs_.size(); ++i)
+      if (addrs_[i] == p) return offsets_[i];
+    throw std::invalid_argument("snapshot: not a member listed in JSON_MEMBER");
+  }
+  size_t size() const { return size_; }
+
+private:
+  snapshot_layout() : obj_(), size_(0) {
+    obj_.visit_members_([this](size_t, const auto& m) {
+      using M = typename std::decay<decltype(m)>::type;
+      offsets_.push_back(size_);
+      addrs_.push_back(reinterpret_cast<const char*>(&m));
+      size_ += flat_size<M>();
+    });
+  }
+
+  const T                  obj_;
+  std::vector<size_t>      offsets_;
+  std::vector<const char*> addrs_;
+  size_t                   size_;
+};
+
+//-------------------------------------------------- flat_size
+template <typename T>
+auto flat_size_(priority<2>) ->
+    typename std::enable_if<has_members_<T>::value, size_t>::type {
+  return snapshot_layout<T>::get().size();
+}
+template <typename T>
+auto flat_size_(priority<1>) ->
+    typename std::enable_if<is_raw_packed<T>::value, size_t>::type {
+  return sizeof(T);
+}
+template <typename T>
+struct flat_size_of {
+  static size_t value() { return flat_size_<T>(priority<2>()); }
+};
+template <>
+struct flat_size_of<std::string> {
+  static size_t value() { return 16; }
+};
+template <typename T, typename A>
+struct flat_size_of<std::vector<T, A>> {
+  static size_t value() { return 16; }
+};
+template <typename T, size_t N>
+struct flat_size_of<std::array<T, N>> {
+  static size_t value() { return N * flat_size<T>(); }
+};
+
+template <typename T>
+size_t flat_size() {
+  return flat_size_of<T>::value();
+}
+
+//-------------------------------------------------- writer
+class snapshot_writer {
+public:
+  std::vector<char> buf;
+
+  // reserves n bytes aligned to 8 and returns the position
+  size_t alloc(size_t n) {
+    const size_t pos = (buf.size() + 7) & ~size_t(7);
+    buf.resize(pos + n);
+    return pos;
+  }
+  void put(size_t at, const void* s, size_t n) {
+    if (n) std::memcpy(&buf[at], s, n);
+  }
+  void put_ref(size_t at, size_t target, uint64_t count) {
+    const int64_t rel = int64_t(target) - int64_t(at);
+    put(at, &rel, sizeof(rel));
+    put(at + 8, &count, sizeof(count));
+  }
+
+  template <typename T>
+  void write(size_t at, const T& v) {
+    write_(at, v, priority<2>());
+  }
+
+private:
+  template <typename T>
+  auto write_(size_t at, const T& v, priority<2>) ->
+      typename std::enable_if<has_members_<T>::value>::type {
+    const auto& l = snapshot_layout<T>::get();
+    v.visit_members_([this, at, &l](size_t pos, const auto& m) {
+      write(at + l.offset(pos), m);
+    });
+  }
+  template <typename T>
+  auto write_(size_t at, const T& v, priority<1>) ->
+      typename std::enable_if<is_raw_packed<T>::value>::type {
+    put(at, &v, sizeof(v));
+  }
+  void write_(size_t at, const std::string& v, priority<1>) {
+    const size_t h = alloc(v.size() + 1);  // null terminated
+    put(h, v.c_str(), v.size() + 1);
+    put_ref(at, h, v.size());
+  }
+  template <typename T, typename A>
+  void write_(size_t at, const std::vector<T, A>& v, priority<1>) {
+    const size_t fs = flat_size<T>();
+    const size_t h  = alloc(v.size() * fs);
+    put_ref(at, h, v.size());
+    if (is_raw_packed<T>::value) return put(h, v.data(), v.size() * fs);
+    for (size_t i = 0; i != v.size(); ++i) write(h + i * fs, v[i]);
+  }
+  template <typename T, size_t N>
+  void write_(size_t at, const std::array<T, N>& v, priority<1>) {
+    const size_t fs = flat_size<T>();
+    for (size_t i = 0; i != N; ++i) write(at + i * fs, v[i]);
+  }
+};
+
+struct snapshot_header {
+  char     magic[8];
+  uint64_t schema;
+  uint64_t size;  // file size
+  uint64_t root;  // offset of root record
+};
+static const char snapshot_magic[8] = {'Y', 'O', 'S', 'S', 'N', 'A', 'P', '1'};
+
+template <typename T>
+void write_snapshot(const T& v, const std::string& path) {
+  snapshot_writer w;
+  w.alloc(sizeof(snapshot_header));
+  const size_t root = w.alloc(flat_size<T>());
+  w.write(root, v);
+  snapshot_header h;
+  std::memcpy(h.magic, snapshot_magic, sizeof(h.magic));
+  h.schema = schema_fingerprint<T>();
+  h.size   = w.buf.size();
+  h.root   = root;
+  w.put(0, &h, sizeof(h));
+
+  const std::string tmp = path + ".tmp";
+  FILE*             f   = std::fopen(tmp.c_str(), "wb");
+  if (!f) throw std::system_error(errno, std::generic_category(), tmp);
+  // data reaches the disk before the file is renamed
+  bool ok = std::fwrite(w.buf.data(), 1, w.buf.size(), f) == w.buf.size() &&
+            std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+  int err = ok ? 0 : errno;
+  if (std::fclose(f) != 0 && ok) {
+    ok  = false;
+    err = errno;
+  }
+  if (ok && std::rename(tmp.c_str(), path.c_str()) != 0) {
+    ok  = false;
+    err = errno;
+  }
+  if (!ok) {
+    std::remove(tmp.c_str());
+    throw std::system_error(err, std::generic_category(), path);
+  }
+}
+
+//-------------------------------------------------- reader
+template <typename T>
+class snapshot_ref;
+template <typename T>
+class snapshot_array;
+
+class snapshot_string {
+public:
+  snapshot_string(const char* p, size_t n) : p_(p), n_(n) {}
+  const char* data() const { return p_; }  // null terminated
+  const char* c_str() const { return p_; }
+  size_t      size() const { return n_; }
+  std::string str() const { return std::string(p_, n_); }
+
+private:
+  const char* p_;
+  size_t      n_;
+};
+
+// mapped file
+struct snapshot_bounds {
+  const char* begin;
+  const char* end;
+};
+
+// reference stored at p: {relative offset, count} to count elements of
+// elem bytes followed by extra bytes, all within b.
+inline std::pair<const char*, size_t> snapshot_deref(const char*            p,
+                                                     const snapshot_bounds& b,
+                                                     size_t elem,
+                                                     size_t extra = 0) {
+  int64_t  rel;
+  uint64_t n;
+  std::memcpy(&rel, p, sizeof(rel));
+  std::memcpy(&n, p + 8, sizeof(n));
+  const uint64_t length = b.end - b.begin;
+  const int64_t  at     = int64_t(p - b.begin);
+  // offset of the target from begin, without overflow
+  if ((rel < 0 && -uint64_t(rel) > uint64_t(at)) ||
+      (rel >= 0 && uint64_t(rel) > length - at))
+    throw std::runtime_error("snapshot: offset out of the file");
+  const uint64_t room = length - uint64_t(at + rel);
+  if (extra > room || (elem && n > (room - extra) / elem))
+    throw std::runtime_error("snapshot: count out of the file");
+  return std::make_pair(p + rel, size_t(n));
+}
+
+template <typename T, typename = void>
+struct snapshot_type {  // arithmetic, enum
+  using type = T;
+  static T get(const char* p, const snapshot_bounds&) {
+    T v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+};
+template <typename T>
+struct snapshot_type<T, typename std::enable_if<has_members_<T>::value>::type> {
+  using type = snapshot_ref<T>;
+  static type get(const char* p, const snapshot_bounds& b) {
+    return type(p, b);
+  }
+};
+template <>
+struct snapshot_type<std::string> {
+  using type = snapshot_string;
+  static type get(const char* p, const snapshot_bounds& b) {
+    const auto r = snapshot_deref(p, b, 1, 1);
+    if (r.first[r.second] != '\0')
+      throw std::runtime_error("snapshot: string is not terminated");
+    return type(r.first, r.second);
+  }
+};
+template <typename T, typename A>
+struct snapshot_type<std::vector<T, A>> {
+  using type = snapshot_array<T>;
+  static type get(const char* p, const snapshot_bounds& b) {
+    const auto r = snapshot_deref(p, b, flat_size<T>());
+    return type(r.first, r.second, b);
+  }
+};
+template <typename T, size_t N>
+struct snapshot_type<std::array<T, N>> {
+  using type = snapshot_array<T>;
+  static type get(const char* p, const snapshot_bounds& b) {
+    return type(p, N, b);
+  }
+};
+
+template <typename T>
+class snapshot_array {
+public:
+  snapshot_array(const char* p, size_t n, const snapshot_bounds& b)
+      : p_(p), n_(n), b_(b) {}
+  size_t size() const { return n_; }
+  bool   empty() const { return n_ == 0; }
+  typename snapshot_type<T>::type operator[](size_t i) const {
+    if (i >= n_) throw std::out_of_range("snapshot_array: index out of range");
+    return snapshot_type<T>::get(p_ + i * flat_size<T>(), b_);
+  }
+  const char* data() const { return p_; }
+
+private:
+  const char*     p_;
+  size_t          n_;
+  snapshot_bounds b_;
+};
+
+// copies snapshot at p to v
+template <typename T>
+auto snapshot_load(const char* p, const snapshot_bounds& b, T& v, priority<2>)
+    -> typename std::enable_if<has_members_<T>::value>::type {
+  const auto& l = snapshot_layout<T>::get();
+  v.visit_members_([p, &b, &l](size_t pos, auto& m) {
+    snapshot_load(p + l.offset(pos), b, m, priority<2>());
+  });
+}
+template <typename T>
+auto snapshot_load(const char* p, const snapshot_bounds&, T& v, priority<1>)
+    -> typename std::enable_if<is_raw_packed<T>::value>::type {
+  std::memcpy(&v, p, sizeof(v));
+}
+inline void snapshot_load(const char* p, const snapshot_bounds& b,
+                          std::string& v, priority<1>) {
+  const auto r = snapshot_deref(p, b, 1);
+  v.assign(r.first, r.second);
+}
+template <typename T, typename A>
+void snapshot_load(const char* p, const snapshot_bounds& b,
+                   std::vector<T, A>& v, priority<1>) {
+  const size_t fs = flat_size<T>();
+  const auto   r  = snapshot_deref(p, b, fs);
+  v.resize(r.second);
+  if (is_raw_packed<T>::value && r.second)
+    return (void)std::memcpy(&v[0], r.first, r.second * fs);
+  for (size_t i = 0; i != v.size(); ++i)
+    snapshot_load(r.first + i * fs, b, v[i], priority<2>());
+}
+template <typename T, size_t N>
+void snapshot_load(const char* p, const snapshot_bounds& b,
+                   std::array<T, N>& v, priority<1>) {
+  const size_t fs = flat_size<T>();
+  for (size_t i = 0; i != N; ++i)
+    snapshot_load(p + i * fs, b, v[i], priority<2>());
+}
+
+template <typename T>
+class snapshot_ref {
+public:
+  snapshot_ref(const char* p, const snapshot_bounds& b) : p_(p), b_(b) {}
+
+  template <typename M>
+  typename snapshot_type<M>::type operator[](M T::*m) const {
+    return snapshot_type<M>::get(p_ + snapshot_layout<T>::get().offset(m), b_);
+  }
+
+  T load() const {
+    T v;
+    snapshot_load(p_, b_, v, priority<2>());
+    return v;
+  }
+  const char* data() const { return p_; }
+
+private:
+  const char*     p_;
+  snapshot_bounds b_;
+};
+
+template <typename T>
+class snapshot {
+public:
+  explicit snapshot(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(snapshot_header)) {
+      ::close(fd);
+      throw std::runtime_error("snapshot: " + path + " is not a snapshot");
+    }
+    length_ = st.st_size;
+    void* p = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+      throw std::system_error(errno, std::generic_category(), path);
+    base_ = static_cast<const char*>(p);
+
+    snapshot_header h;
+    std::memcpy(&h, base_, sizeof(h));
+    const char* err =
+        std::memcmp(h.magic, snapshot_magic, sizeof(h.magic)) != 0 ||
+                h.size != length_ || h.root > length_ ||
+                flat_size<T>() > length_ - h.root
+            ? " is not a snapshot"
+            : h.schema != schema_fingerprint<T>() ? " has stale schema"
+                                                  : nullptr;
+    if (err) {
+      munmap(const_cast<char*>(base_), length_);
+      throw std::runtime_error("snapshot: " + path + err);
+    }
+    root_ = base_ + h.root;
+  }
+  snapshot(snapshot&& o) : base_(o.base_), root_(o.root_), length_(o.length_) {
+    o.base_ = nullptr;
+  }
+  snapshot(const snapshot&) = delete;
+  snapshot& operator=(const snapshot&) = delete;
+  ~snapshot() {
+    if (base_) munmap(const_cast<char*>(base_), length_);
+  }
+
+  snapshot_ref<T> root() const {
+    return snapshot_ref<T>(root_, snapshot_bounds{base_, base_ + length_});
+  }
+
+private:
+  const char* base_;
+  const char* root_;
+  size_t      length_;
+};
+}
@@ -0,0 +1,535 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * Floating point formatting is a constexpr port of the Grisu2 implementation
+ * in nlohmann::json (MIT license),
+ * Copyright (c) 2009 Florian Loitsch, 2013-2022 Niels Lohmann.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  Compile time json generation for constexpr objects.
+
+    yos::static_json<T, V>::value
+    YOS_STATIC_JSON(V)::value
+      static constexpr null-terminated text of constexpr object V, rendered
+      while compiling. ::size is the length of the text.
+
+        constexpr pose default_pose{0.0, 0.0, 1.5};
+        const char* s = YOS_STATIC_JSON(default_pose)::value;
+
+      V must have static storage duration, e.g. a constexpr variable in a
+      namespace or a static constexpr class member.
+
+  Members may be bool, arithmetic, enum, std::array, C array and structs
+  marked with JSON_MEMBER(). Enumerations with JSON_ENUM() are names. The
+  text is identical to nlohmann::json(V).dump(): structs are objects with
+  members sorted by name, or arrays for JSON_MEMBER_ARRAY(), and doubles
+  are in the shortest form. Structs with JSON_FLOAT_FORMAT() are rejected
+  by static_assert since the formats are not evaluated while compiling.
+
+  Not available with NOCONSTEXPR.
+*/
+
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include "jsonutil.hh"
+
+#ifndef NOCONSTEXPR
+namespace yos {
+namespace cx {
+
+//-------------------------------------------------- Grisu2
+struct diyfp {  // f * 2^e
+  uint64_t f;
+  int      e;
+};
+
+constexpr diyfp sub(diyfp x, diyfp y) { return diyfp{x.f - y.f, x.e}; }
+
+// upper 64 bits of x.f * y.f, rounded
+constexpr diyfp mul(diyfp x, diyfp y) {
+  const uint64_t u_lo = x.f & 0xFFFFFFFFu;
+  const uint64_t u_hi = x.f >> 32u;
+  const uint64_t v_lo = y.f & 0xFFFFFFFFu;
+  const uint64_t v_hi = y.f >> 32u;
+  const uint64_t p0   = u_lo * v_lo;
+  const uint64_t p1   = u_lo * v_hi;
+  const uint64_t p2   = u_hi * v_lo;
+  const uint64_t p3   = u_hi * v_hi;
+  uint64_t q = (p0 >> 32u) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+  q += uint64_t{1} << 31u;  // round, ties up
+  return diyfp{p3 + (p2 >> 32u) + (p1 >> 32u) + (q >> 32u), x.e + y.e + 64};
+}
+
+constexpr diyfp normalize(diyfp x) {
+  while ((x.f >> 63u) == 0) {
+    x.f <<= 1u;
+    x.e--;
+  }
+  return x;
+}
+
+constexpr diyfp normalize_to(diyfp x, int e) {
+  return diyfp{x.f << (x.e - e), e};
+}
+
+struct boundaries {
+  diyfp w, minus, plus;
+};
+
+// value must be finite and positive
+constexpr boundaries compute_boundaries(double value) {
+  // value = v * 2^e, 1 <= v < 2. scaling by powers of 2 is exact.
+  constexpr double two64 = 18446744073709551616.0;
+  double           v     = value;
+  int              e     = 0;
+  while (v >= two64) v /= two64, e += 64;
+  while (v >= 2) v /= 2, ++e;
+  while (v < 1 / two64) v *= two64, e -= 64;
+  while (v < 1) v *= 2, --e;
+
+  constexpr int      kBias      = 1075;
+  constexpr uint64_t kHiddenBit = uint64_t{1} << 52;
+  uint64_t           E          = 0;
+  uint64_t           F          = 0;
+  if (e < -1022) {  // denormal
+    double s = v;
+    for (int i = 0; i < e + 1074; ++i) s *= 2;
+    F = static_cast<uint64_t>(s);
+  } else {
+    E = static_cast<uint64_t>(e + 1023);
+    F = static_cast<uint64_t>((v - 1) * static_cast<double>(kHiddenBit));
+  }
+
+  const diyfp w = E == 0 ? diyfp{F, 1 - kBias}
+                         : diyfp{F + kHiddenBit, static_cast<int>(E) - kBias};
+  const bool  lower_boundary_is_closer = F == 0 && E > 1;
+  const diyfp m_plus                   = diyfp{2 * w.f + 1, w.e - 1};
+  const diyfp m_minus = lower_boundary_is_closer ? diyfp{4 * w.f - 1, w.e - 2}
+                                                 : diyfp{2 * w.f - 1, w.e - 1};
+  const diyfp w_plus  = normalize(m_plus);
+  return boundaries{normalize(w), normalize_to(m_minus, w_plus.e), w_plus};
+}
+
+constexpr int kAlpha = -60;
+constexpr int kGamma = -32;
+
+struct cached_power {  // c = f * 2^e ~= 10^k
+  uint64_t f;
+  int      e;
+  int      k;
+};
+
+constexpr cached_power kCachedPowers[] = {
+    {0xAB70FE17C79AC6CA, -1060, -300}, {0xFF77B1FCBEBCDC4F, -1034, -292},
+    {0xBE5691EF416BD60C, -1007, -284}, {0x8DD01FAD907FFC3C, -980, -276},
+    {0xD3515C2831559A83, -954, -268},  {0x9D71AC8FADA6C9B5, -927, -260},
+    {0xEA9C227723EE8BCB, -901, -252},  {0xAECC49914078536D, -874, -244},
+    {0x823C12795DB6CE57, -847, -236},  {0xC21094364DFB5637, -821, -228},
+    {0x9096EA6F3848984F, -794, -220},  {0xD77485CB25823AC7, -768, -212},
+    {0xA086CFCD97BF97F4, -741, -204},  {0xEF340A98172AACE5, -715, -196},
+    {0xB23867FB2A35B28E, -688, -188},  {0x84C8D4DFD2C63F3B, -661, -180},
+    {0xC5DD44271AD3CDBA, -635, -172},  {0x936B9FCEBB25C996, -608, -164},
+    {0xDBAC6C247D62A584, -582, -156},  {0xA3AB66580D5FDAF6, -555, -148},
+    {0xF3E2F893DEC3F126, -529, -140},  {0xB5B5ADA8AAFF80B8, -502, -132},
+    {0x87625F056C7C4A8B, -475, -124},  {0xC9BCFF6034C13053, -449, -116},
+    {0x964E858C91BA2655, -422, -108},  {0xDFF9772470297EBD, -396, -100},
+    {0xA6DFBD9FB8E5B88F, -369, -92},   {0xF8A95FCF88747D94, -343, -84},
+    {0xB94470938FA89BCF, -316, -76},   {0x8A08F0F8BF0F156B, -289, -68},
+    {0xCDB02555653131B6, -263, -60},   {0x993FE2C6D07B7FAC, -236, -52},
+    {0xE45C10C42A2B3B06, -210, -44},   {0xAA242499697392D3, -183, -36},
+    {0xFD87B5F28300CA0E, -157, -28},   {0xBCE5086492111AEB, -130, -20},
+    {0x8CBCCC096F5088CC, -103, -12},   {0xD1B71758E219652C, -77, -4},
+    {0x9C40000000000000, -50, 4},      {0xE8D4A51000000000, -24, 12},
+    {0xAD78EBC5AC620000, 3, 20},       {0x813F3978F8940984, 30, 28},
+    {0xC097CE7BC90715B3, 56, 36},      {0x8F7E32CE7BEA5C70, 83, 44},
+    {0xD5D238A4ABE98068, 109, 52},     {0x9F4F2726179A2245, 136, 60},
+    {0xED63A231D4C4FB27, 162, 68},     {0xB0DE65388CC8ADA8, 189, 76},
+    {0x83C7088E1AAB65DB, 216, 84},     {0xC45D1DF942711D9A, 242, 92},
+    {0x924D692CA61BE758, 269, 100},    {0xDA01EE641A708DEA, 295, 108},
+    {0xA26DA3999AEF774A, 322, 116},    {0xF209787BB47D6B85, 348, 124},
+    {0xB454E4A179DD1877, 375, 132},    {0x865B86925B9BC5C2, 402, 140},
+    {0xC83553C5C8965D3D, 428, 148},    {0x952AB45CFA97A0B3, 455, 156},
+    {0xDE469FBD99A05FE3, 481, 164},    {0xA59BC234DB398C25, 508, 172},
+    {0xF6C69A72A3989F5C, 534, 180},    {0xB7DCBF5354E9BECE, 561, 188},
+    {0x88FCF317F22241E2, 588, 196},    {0xCC20CE9BD35C78A5, 614, 204},
+    {0x98165AF37B2153DF, 641, 212},    {0xE2A0B5DC971F303A, 667, 220},
+    {0xA8D9D1535CE3B396, 694, 228},    {0xFB9B7CD9A4A7443C, 720, 236},
+    {0xBB764C4CA7A44410, 747, 244},    {0x8BAB8EEFB6409C1A, 774, 252},
+    {0xD01FEF10A657842C, 800, 260},    {0x9B10A4E5E9913129, 827, 268},
+    {0xE7109BFBA19C0C9D, 853, 276},    {0xAC2820D9623BF429, 880, 284},
+    {0x80444B5E7AA7CF85, 907, 292},    {0xBF21E44003ACDD2D, 933, 300},
+    {0x8E679C2F5E44FF8F, 960, 308},    {0xD433179D9C8CB841, 986, 316},
+    {0x9E19DB92B4E31BA9, 1013, 324},
+};
+
+// cached power c such that kAlpha <= c.e + e + 64 <= kGamma
+constexpr cached_power get_cached_power_for_binary_exponent(int e) {
+  const int f     = kAlpha - e - 1;
+  const int k     = (f * 78913) / (1 << 18) + static_cast<int>(f > 0);
+  const int index = (300 + k + 7) / 8;
+  return kCachedPowers[index];
+}
+
+// returns k such that pow10 := 10^(k-1) <= n < 10^k
+constexpr int find_largest_pow10(uint32_t n, uint32_t& pow10) {
+  int k = 1;
+  pow10 = 1;
+  while (k < 10 && n / pow10 >= 10) {
+    pow10 *= 10;
+    ++k;
+  }
+  return k;
+}
+
+constexpr void grisu2_round(char* buf, int len, uint64_t dist, uint64_t delta,
+                            uint64_t rest, uint64_t ten_k) {
+  while (rest < dist && delta - rest >= ten_k &&
+         (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+    buf[len - 1]--;
+    rest += ten_k;
+  }
+}
+
+constexpr void grisu2_digit_gen(char* buffer, int& length,
+                                int& decimal_exponent, diyfp M_minus, diyfp w,
+                                diyfp M_plus) {
+  uint64_t    delta = sub(M_plus, M_minus).f;
+  uint64_t    dist  = sub(M_plus, w).f;
+  const diyfp one{uint64_t{1} << -M_plus.e, M_plus.e};
+  uint32_t    p1 = static_cast<uint32_t>(M_plus.f >> -one.e);
+  uint64_t    p2 = M_plus.f & (one.f - 1);
+
+  uint32_t pow10 = 0;
+  int      n     = find_largest_pow10(p1, pow10);
+  while (n > 0) {
+    const uint32_t d = p1 / pow10;
+    const uint32_t r = p1 % pow10;
+    buffer[length++] = static_cast<char>('0' + d);
+    p1               = r;
+    n--;
+    const uint64_t rest = (uint64_t{p1} << -one.e) + p2;
+    if (rest <= delta) {
+      decimal_exponent += n;
+      grisu2_round(buffer, length, dist, delta, rest,
+                   uint64_t{pow10} << -one.e);
+      return;
+    }
+    pow10 /= 10;
+  }
+
+  int m = 0;
+  for (;;) {
+    p2 *= 10;
+    const uint64_t d = p2 >> -one.e;
+    const uint64_t r = p2 & (one.f - 1);
+    buffer[length++] = static_cast<char>('0' + d);
+    p2               = r;
+    m++;
+    delta *= 10;
+    dist *= 10;
+    if (p2 <= delta) break;
+  }
+  decimal_exponent -= m;
+  grisu2_round(buffer, length, dist, delta, p2, one.f);
+}
+
+// value = buf * 10^decimal_exponent
+constexpr void grisu2(char* buf, int& len, int& decimal_exponent,
+                      double value) {
+  const boundaries   b      = compute_boundaries(value);
+  const cached_power cached = get_cached_power_for_binary_exponent(b.plus.e);
+  const diyfp        c_minus_k{cached.f, cached.e};
+  const diyfp        w       = mul(b.w, c_minus_k);
+  const diyfp        w_minus = mul(b.minus, c_minus_k);
+  const diyfp        w_plus  = mul(b.plus, c_minus_k);
+  decimal_exponent           = -cached.k;
+  grisu2_digit_gen(buf, len, decimal_exponent,
+                   diyfp{w_minus.f + 1, w_minus.e}, w,
+                   diyfp{w_plus.f - 1, w_plus.e});
+}
+
+constexpr char* append_exponent(char* buf, int e) {
+  *buf++ = e < 0 ? '-' : '+';
+  uint32_t k = static_cast<uint32_t>(e < 0 ? -e : e);
+  if (k >= 100) {
+    *buf++ = static_cast<char>('0' + k / 100);
+    k %= 100;
+  }
+  *buf++ = static_cast<char>('0' + k / 10);
+  *buf++ = static_cast<char>('0' + k % 10);
+  return buf;
+}
+
+constexpr void move_chars(char* dst, const char* src, int n) {
+  if (dst > src)
+    for (int i = n; i-- > 0;) dst[i] = src[i];
+  else
+    for (int i = 0; i < n; ++i) dst[i] = src[i];
+}
+
+// v = buf * 10^decimal_exponent in fixed point notation if it is in
+// [10^min_exp, 10^max_exp), otherwise in exponential notation
+constexpr char* format_buffer(char* buf, int len, int decimal_exponent,
+                              int min_exp, int max_exp) {
+  const int k = len;
+  const int n = len + decimal_exponent;
+
+  if (k <= n && n <= max_exp) {  // digits[000].0
+    for (int i = k; i < n; ++i) buf[i] = '0';
+    buf[n + 0] = '.';
+    buf[n + 1] = '0';
+    return buf + n + 2;
+  }
+  if (0 < n && n <= max_exp) {  // dig.its
+    move_chars(buf + n + 1, buf + n, k - n);
+    buf[n] = '.';
+    return buf + k + 1;
+  }
+  if (min_exp < n && n <= 0) {  // 0.[000]digits
+    move_chars(buf + 2 - n, buf, k);
+    buf[0] = '0';
+    buf[1] = '.';
+    for (int i = 0; i < -n; ++i) buf[2 + i] = '0';
+    return buf + 2 - n + k;
+  }
+  if (k == 1) {  // dE+123
+    buf += 1;
+  } else {  // d.igitsE+123
+    move_chars(buf + 2, buf + 1, k - 1);
+    buf[1] = '.';
+    buf += 1 + k;
+  }
+  *buf++ = 'e';
+  return append_exponent(buf, n - 1);
+}
+
+constexpr bool signbit(double v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_signbit(v);
+#else
+  return v < 0;
+#endif
+}
+
+// same output as nlohmann::detail::to_chars(). value must be finite.
+constexpr char* to_chars(char* first, double value) {
+  if (signbit(value)) {
+    value    = -value;
+    *first++ = '-';
+  }
+  if (value == 0) {
+    *first++ = '0';
+    *first++ = '.';
+    *first++ = '0';
+    return first;
+  }
+  int len              = 0;
+  int decimal_exponent = 0;
+  grisu2(first, len, decimal_exponent, value);
+  return format_buffer(first, len, decimal_exponent, -4, 15);
+}
+
+//-------------------------------------------------- renderer
+struct writer {
+  char*  buf;  // nullptr to count length only
+  size_t pos;
+
+  constexpr void put(char c) {
+    if (buf) buf[pos] = c;
+    ++pos;
+  }
+  constexpr void put(const char* s, size_t n) {
+    for (size_t i = 0; i != n; ++i) put(s[i]);
+  }
+};
+
+template <typename T>
+constexpr void render(writer& w, const T& v);
+
+template <typename T>
+constexpr auto render_(writer& w, T v, priority<2>) ->
+    typename std::enable_if<std::is_same<T, bool>::value>::type {
+  v ? w.put("true", 4) : w.put("false", 5);
+}
+
+// JSON_ENUM() enumeration as its name
+template <typename T>
+constexpr auto render_(writer& w, T v, priority<2>) ->
+    typename std::enable_if<is_json_enum<T>::value>::type {
+  using names = json_enum_names<T>;
+  const auto name =
+      tokenize<names::members_size_()>(names::members_())[size_t(v)];
+  w.put('"');
+  w.put(name.first, name.second);
+  w.put('"');
+}
+
+template <typename T>
+constexpr auto render_(writer& w, T v, priority<1>) ->
+    typename std::enable_if<std::is_floating_point<T>::value>::type {
+  const double d = v;
+  if (d != d || d > 1.7976931348623157e308 || d < -1.7976931348623157e308)
+    return w.put("null", 4);
+  char        buf[32] = {};
+  const char* end     = to_chars(buf, d);
+  w.put(buf, end - buf);
+}
+
+template <typename T>
+constexpr auto render_(writer& w, T v, priority<1>) ->
+    typename std::enable_if<std::is_integral<T>::value ||
+                            std::is_enum<T>::value>::type {
+  using I = typename std::conditional<std::is_enum<T>::value,
+                                      std::underlying_type<T>,
+                                      std::common_type<T>>::type::type;
+  const I  i = static_cast<I>(v);
+  uint64_t u = i < 0 ? 0 - static_cast<uint64_t>(i) : static_cast<uint64_t>(i);
+  char     buf[20] = {};
+  int      n       = 0;
+  do {
+    buf[n++] = static_cast<char>('0' + u % 10);
+    u /= 10;
+  } while (u);
+  if (i < 0) w.put('-');
+  while (n) w.put(buf[--n]);
+}
+
+template <typename T>
+constexpr void render_elements(writer& w, const T& v, size_t n) {
+  w.put('[');
+  for (size_t i = 0; i != n; ++i) {
+    if (i) w.put(',');
+    render(w, v[i]);
+  }
+  w.put(']');
+}
+
+template <typename T, size_t N>
+constexpr void render_(writer& w, const std::array<T, N>& v, priority<1>) {
+  render_elements(w, v, N);
+}
+
+template <typename T, size_t N>
+constexpr void render_(writer& w, const T (&v)[N], priority<1>) {
+  render_elements(w, v, N);
+}
+
+// member i of v. I is the index tried.
+template <size_t I, typename T>
+constexpr auto render_member(writer& w, const T& v, size_t i) ->
+    typename std::enable_if<(I >= T::members_size_())>::type {}
+
+template <size_t I, typename T>
+constexpr auto render_member(writer& w, const T& v, size_t i) ->
+    typename std::enable_if<(I < T::members_size_())>::type {
+  if (i == I) return render(w, std::get<I>(v.members_tie_()));
+  render_member<I + 1>(w, v, i);
+}
+
+constexpr bool name_less(std::pair<const char*, size_t> a,
+                         std::pair<const char*, size_t> b) {
+  for (size_t i = 0; i != a.second && i != b.second; ++i) {
+    if (a.first[i] != b.first[i])
+      return static_cast<unsigned char>(a.first[i]) <
+             static_cast<unsigned char>(b.first[i]);
+  }
+  return a.second < b.second;
+}
+
+template <typename T, typename = void>
+struct has_float_format : std::false_type {};
+template <typename T>
+struct has_float_format<T, decltype(T::json_float_format_(0), void())>
+    : std::true_type {};
+
+// JSON_MEMBER struct as object with members sorted by name, or as array
+// for JSON_MEMBER_ARRAY()
+template <typename T>
+constexpr auto render_(writer& w, const T& v, priority<0>)
+    -> decltype(T::members_size_(), void()) {
+  static_assert(!has_float_format<T>::value,
+                "JSON_FLOAT_FORMAT is not applied while compiling");
+  constexpr size_t N = T::members_size_();
+  if (!has_to_json_obj<T, nlohmann::json>::value) {
+    w.put('[');
+    for (size_t i = 0; i != N; ++i) {
+      if (i) w.put(',');
+      render_member<0>(w, v, i);
+    }
+    w.put(']');
+    return;
+  }
+  const auto names   = tokenize<N>(T::members_());
+  bool       done[N] = {};
+  w.put('{');
+  for (size_t k = 0; k != N; ++k) {
+    size_t m = N;
+    for (size_t i = 0; i != N; ++i) {
+      if (!done[i] && (m == N || name_less(names[i], names[m]))) m = i;
+    }
+    done[m] = true;
+    if (k) w.put(',');
+    w.put('"');
+    w.put(names[m].first, names[m].second);
+    w.put('"');
+    w.put(':');
+    render_member<0>(w, v, m);
+  }
+  w.put('}');
+}
+
+template <typename T>
+constexpr void render(writer& w, const T& v) {
+  render_(w, v, priority<2>());
+}
+
+template <typename T>
+constexpr size_t rendered_size(const T& v) {
+  writer w{nullptr, 0};
+  render(w, v);
+  return w.pos;
+}
+}  // namespace cx
+
+template <size_t N>
+struct static_string {
+  char data[N + 1];
+};
+
+template <size_t N, typename T>
+constexpr static_string<N> render_static(const T& v) {
+  static_string<N> s{};
+  cx::writer       w{s.data, 0};
+  cx::render(w, v);
+  return s;
+}
+
+template <typename T, const T& V>
+struct static_json {
+  static constexpr size_t                 size    = cx::rendered_size(V);
+  static constexpr static_string<size>    storage = render_static<size>(V);
+  static constexpr const char*            value   = storage.data;
+};
+template <typename T, const T& V>
+constexpr size_t static_json<T, V>::size;
+template <typename T, const T& V>
+constexpr static_string<static_json<T, V>::size> static_json<T, V>::storage;
+template <typename T, const T& V>
+constexpr const char* static_json<T, V>::value;
+}
+
+#define YOS_STATIC_JSON(V) yos::static_json<decltype(V), V>
+#endif
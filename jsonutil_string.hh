@@ -0,0 +1,325 @@
+#pragma once
+
+/****************************************************************************
+ * jsonutil: Utilities to write serialization functions for nlohmann::json
+ * Copyright (C) 2018 Tomoaki Yoshida
+ * Copyright (C) 2017 Future Robotics Technology Center (fuRo),
+ *                    Chiba Institute of Technology.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ ****************************************************************************/
+
+//======================================================================
+/*
+  String kernels for json text.
+
+    yos::string_kernels
+      Set of functions working on 16 (SSE2) or 32 (AVX2) bytes at a time.
+
+      size_t escape_scan(const char* s, size_t n)
+        Index of the first byte json requires to escape ('"', '\\' and
+        control characters), or n.
+      size_t copy_clean(char* d, const char* s, size_t n)
+        Copies s to d up to the first byte to escape. Returns the number of
+        bytes copied.
+      bool validate_utf8(const char* s, size_t n)
+        true if s is well-formed UTF-8. Runs of ASCII are skipped by vector
+        instructions and other characters are decoded one by one.
+
+    static const string_kernels& string_kernels::best()
+      Kernels for the running CPU, chosen at the first call.
+    static const string_kernels& string_kernels::get(simd l)
+      Kernels for l (simd::scalar, simd::sse2 or simd::avx2). Falls back to
+      the best supported level below l.
+
+    void append_escaped(std::string& out, const char* s, size_t n)
+      Appends s as a quoted json string. Non-ASCII characters are copied as
+      is, like dump() of nlohmann::json. s must be valid UTF-8.
+
+  AVX2 is selected at runtime on x86 with gcc or clang, without compiling
+  the rest of the program for AVX2.
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define YOS_STRING_AVX2
+#endif
+
+namespace yos {
+
+enum class simd { scalar, sse2, avx2 };
+
+namespace string_kernel {
+
+inline bool needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+// index of the lowest set bit. x must not be 0.
+inline int ctz(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(x);
+#else
+  int i = 0;
+  while (!(x & 1)) x >>= 1, ++i;
+  return i;
+#endif
+}
+inline int ctz(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  int i = 0;
+  while (!(x & 1)) x >>= 1, ++i;
+  return i;
+#endif
+}
+
+// length of well-formed UTF-8 sequence at s, 0 if malformed (RFC 3629)
+inline size_t utf8_sequence(const unsigned char* s, size_t n) {
+  const unsigned char c = s[0];
+  size_t              len;
+  unsigned char       lo = 0x80, hi = 0xBF;  // range of the second byte
+  if (c < 0x80) return 1;
+  if (c < 0xC2) return 0;
+  if (c < 0xE0) {
+    len = 2;
+  } else if (c < 0xF0) {
+    len = 3;
+    if (c == 0xE0) lo = 0xA0;  // overlong
+    if (c == 0xED) hi = 0x9F;  // surrogates
+  } else if (c < 0xF5) {
+    len = 4;
+    if (c == 0xF0) lo = 0x90;  // overlong
+    if (c == 0xF4) hi = 0x8F;  // > U+10FFFF
+  } else {
+    return 0;
+  }
+  if (n < len || s[1] < lo || s[1] > hi) return 0;
+  for (size_t i = 2; i != len; ++i) {
+    if ((s[i] & 0xC0) != 0x80) return 0;
+  }
+  return len;
+}
+
+//-------------------------------------------------- scalar
+inline size_t escape_scan_scalar(const char* s, size_t n) {
+  size_t i = 0;
+  while (i != n && !needs_escape(s[i])) ++i;
+  return i;
+}
+
+inline size_t copy_clean_scalar(char* d, const char* s, size_t n) {
+  const size_t k = escape_scan_scalar(s, n);
+  std::memcpy(d, s, k);
+  return k;
+}
+
+inline bool validate_utf8_scalar(const char* s, size_t n) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+  for (size_t i = 0; i != n;) {
+    const size_t len = utf8_sequence(p + i, n - i);
+    if (len == 0) return false;
+    i += len;
+  }
+  return true;
+}
+
+//-------------------------------------------------- SSE2
+#if defined(__SSE2__)
+// bit i is set if byte i of x is c
+inline uint32_t eq_mask_sse2(__m128i x, char c) {
+  return static_cast<uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(c))));
+}
+
+// bit i is set if byte i needs to be escaped
+inline uint32_t escape_mask_sse2(__m128i x) {
+  const __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(0x1F)), x);
+  return static_cast<uint32_t>(_mm_movemask_epi8(ctrl)) | eq_mask_sse2(x, '"') |
+         eq_mask_sse2(x, '\\');
+}
+
+inline size_t escape_scan_sse2(const char* s, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const uint32_t m = escape_mask_sse2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+    if (m) return i + ctz(m);
+  }
+  return i + escape_scan_scalar(s + i, n - i);
+}
+
+inline size_t copy_clean_sse2(char* d, const char* s, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i  x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    const uint32_t m = escape_mask_sse2(x);
+    if (m) {
+      std::memcpy(d + i, s + i, ctz(m));
+      return i + ctz(m);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), x);
+  }
+  return i + copy_clean_scalar(d + i, s + i, n - i);
+}
+
+inline bool validate_utf8_sse2(const char* s, size_t n) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+  size_t               i = 0;
+  while (i + 16 <= n) {
+    const uint32_t m = _mm_movemask_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+    if (m == 0) {
+      i += 16;
+      continue;
+    }
+    i += ctz(m);
+    const size_t len = utf8_sequence(p + i, n - i);
+    if (len == 0) return false;
+    i += len;
+  }
+  return validate_utf8_scalar(s + i, n - i);
+}
+#endif
+
+//-------------------------------------------------- AVX2
+#ifdef YOS_STRING_AVX2
+__attribute__((target("avx2"))) inline uint32_t escape_mask_avx2(__m256i x) {
+  const __m256i ctrl =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(0x1F)), x);
+  const __m256i quote = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'));
+  const __m256i bs    = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'));
+  return _mm256_movemask_epi8(
+      _mm256_or_si256(ctrl, _mm256_or_si256(quote, bs)));
+}
+
+__attribute__((target("avx2"))) inline size_t escape_scan_avx2(const char* s,
+                                                               size_t      n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const uint32_t m = escape_mask_avx2(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)));
+    if (m) return i + ctz(m);
+  }
+  return i + escape_scan_scalar(s + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline size_t copy_clean_avx2(char*       d,
+                                                              const char* s,
+                                                              size_t      n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+    const uint32_t m = escape_mask_avx2(x);
+    if (m) {
+      std::memcpy(d + i, s + i, ctz(m));
+      return i + ctz(m);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), x);
+  }
+  return i + copy_clean_scalar(d + i, s + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline bool validate_utf8_avx2(const char* s,
+                                                               size_t      n) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+  size_t               i = 0;
+  while (i + 32 <= n) {
+    const uint32_t m = _mm256_movemask_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)));
+    if (m == 0) {
+      i += 32;
+      continue;
+    }
+    i += ctz(m);
+    const size_t len = utf8_sequence(p + i, n - i);
+    if (len == 0) return false;
+    i += len;
+  }
+  return validate_utf8_scalar(s + i, n - i);
+}
+#endif
+}  // namespace string_kernel
+
+struct string_kernels {
+  simd level;
+  size_t (*escape_scan)(const char* s, size_t n);
+  size_t (*copy_clean)(char* d, const char* s, size_t n);
+  bool (*validate_utf8)(const char* s, size_t n);
+
+  static const string_kernels& get(simd l) {
+    namespace k = string_kernel;
+    static const string_kernels scalar{simd::scalar, k::escape_scan_scalar,
+                                       k::copy_clean_scalar,
+                                       k::validate_utf8_scalar};
+#if defined(__SSE2__)
+    static const string_kernels sse2{simd::sse2, k::escape_scan_sse2,
+                                     k::copy_clean_sse2, k::validate_utf8_sse2};
+#endif
+#ifdef YOS_STRING_AVX2
+    static const string_kernels avx2{simd::avx2, k::escape_scan_avx2,
+                                     k::copy_clean_avx2, k::validate_utf8_avx2};
+    if (l == simd::avx2 && __builtin_cpu_supports("avx2")) return avx2;
+#endif
+#if defined(__SSE2__)
+    if (l != simd::scalar) return sse2;
+#endif
+    return scalar;
+  }
+
+  static const string_kernels& best() {
+    static const string_kernels& k = get(simd::avx2);
+    return k;
+  }
+};
+
+inline void append_escaped(std::string& out, const char* s, size_t n,
+                           const string_kernels& k = string_kernels::best()) {
+  static const char hex[] = "0123456789abcdef";
+  // room for the quotes and clean bytes. escapes grow it.
+  size_t pos = out.size();
+  out.resize(pos + n + 2);
+  out[pos++] = '"';
+  while (n) {
+    const size_t c = k.copy_clean(&out[pos], s, n);
+    pos += c;
+    s += c;
+    n -= c;
+    if (!n) break;
+    out.resize(out.size() + 5);  // 1 byte to at most 6 bytes
+    char* d = &out[pos];
+    d[0]    = '\\';
+    switch (*s) {
+      case '"': d[1] = '"'; pos += 2; break;
+      case '\\': d[1] = '\\'; pos += 2; break;
+      case '\b': d[1] = 'b'; pos += 2; break;
+      case '\f': d[1] = 'f'; pos += 2; break;
+      case '\n': d[1] = 'n'; pos += 2; break;
+      case '\r': d[1] = 'r'; pos += 2; break;
+      case '\t': d[1] = 't'; pos += 2; break;
+      default:
+        d[1] = 'u';
+        d[2] = '0';
+        d[3] = '0';
+        d[4] = hex[(*s >> 4) & 0xF];
+        d[5] = hex[*s & 0xF];
+        pos += 6;
+    }
+    ++s;
+    --n;
+  }
+  out[pos++] = '"';
+  out.resize(pos);
+}
+}
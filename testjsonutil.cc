@@ -2,7 +2,16 @@
 #include "catch.hpp"
 #include <nlohmann/json.hpp>
 #include "jsonutil.hh"
+#include "jsonutil_enum.hh"
+#include "jsonutil_push.hh"
+#include "jsonutil_pool.hh"
+#include "jsonutil_shm.hh"
+#include "jsonutil_snapshot.hh"
+#include "jsonutil_static.hh"
+#include "jsonutil_parallel.hh"
+#include "jsonutil_dump.hh"
 #include <array>
+#include <fstream>
 #include <vector>
 struct Point{
   double x,y,z;
@@ -10,18 +19,62 @@ struct Point{
   JSON_MEMBER(x,y,z,id);
 };
 
+struct SpacedPoint{
+  double x,y,z;
+  int id;
+  JSON_MEMBER( x, y ,z,
+               id );
+};
+
 struct Triangle{
   Point p1,p2,p3;
   std::string name;
   JSON_MEMBER(p1,p2,p3,name);
 };
 
+struct Pose{
+  double x,y,theta;
+  float v;
+  int id;
+  JSON_MEMBER(x,y,theta,v,id);
+  JSON_FLOAT_FORMAT(yos::fixed_digits(3), yos::fixed_digits(3),
+                    yos::significant_digits(3), yos::float32_roundtrip(),
+                    yos::full_precision());
+};
+
+struct Poses{
+  std::vector<Pose> poses;
+  double t;
+  JSON_MEMBER_ARRAY(poses,t);
+  JSON_FLOAT_FORMAT(yos::fixed_digits(1));
+};
+
+struct Track{
+  std::vector<double> xs;
+  std::array<float,2> origin;
+  double t;
+  JSON_MEMBER(xs,origin,t);
+  JSON_FLOAT_FORMAT(yos::fixed_digits(2));
+};
+
 struct Points{
   std::vector<Point> pts;
   std::string name;
   JSON_MEMBER(pts,name);
 };
 
+struct Signal{
+  enum Light{red,yellow,green} state;
+  int id;
+  JSON_MEMBER(state,id);
+};
+
+struct Flags{
+  std::vector<bool> on;
+  int id;
+  JSON_MEMBER(on,id);
+};
+
 TEST_CASE("SimpleStruct"){
   Point pt1{1.1, 2.2, 3.3, 4};
   SECTION("member mapping in nlohmann::json"){
@@ -403,3 +456,706 @@ TEST_CASE("Structure with std::vector"){
     }
   }
 }
+
+TEST_CASE("Push parser"){
+  Points tri={
+    {{0,0,0,0},{1.1,2.2,3.3,1},{-3.3,-4.4,-5.5,2}},"three \"points\""
+  };
+  SECTION("byte by byte"){
+    nlohmann::json j=tri;
+    std::string s=j.dump(2);
+    yos::push_parser<Points> pp;
+    for(size_t i=0;i!=s.size();++i){
+      CHECK(!pp.done());
+      CHECK(pp.feed(&s[i],1)==1);
+    }
+    CHECK(pp.done());
+    Points& tri2=pp.get();
+    CHECK(tri.name==tri2.name);
+    CHECK(tri2.pts.size()==3);
+    for(int i=0,ec=tri2.pts.size();i!=ec;++i){
+      CHECK(tri.pts[i].x==tri2.pts[i].x);
+      CHECK(tri.pts[i].y==tri2.pts[i].y);
+      CHECK(tri.pts[i].z==tri2.pts[i].z);
+      CHECK(tri.pts[i].id==tri2.pts[i].id);
+    }
+  }
+  SECTION("consecutive messages in fragments"){
+    Point pt1{1.1, 2.2, 3.3, 4};
+    nlohmann::json j1=pt1;
+    yos::array_json j2=pt1;
+    std::string s=j1.dump()+"\n"+j2.dump()+"\n"+j1.dump();
+    std::vector<Point> pts;
+    yos::push_parser<Point> pp;
+    for(size_t i=0;i<s.size();i+=7){
+      const char* p=&s[i];
+      size_t n=std::min<size_t>(7,s.size()-i);
+      while(n){
+        size_t c=pp.feed(p,n);
+        p+=c;
+        n-=c;
+        if(pp.done()){
+          pts.push_back(pp.get());
+          pp.reset();
+        }
+      }
+    }
+    CHECK(pts.size()==3);
+    for(auto& pt2: pts){
+      CHECK(pt1.x==pt2.x);
+      CHECK(pt1.y==pt2.y);
+      CHECK(pt1.z==pt2.z);
+      CHECK(pt1.id==pt2.id);
+    }
+  }
+  SECTION("leftover bytes"){
+    std::string s=R"({"x":1,"y":2,"z":3,"id":4}{"x")";
+    yos::push_parser<Point> pp;
+    CHECK(pp.feed(s.data(),s.size())==s.size()-4);
+    CHECK(pp.done());
+    CHECK(pp.get().id==4);
+  }
+  SECTION("malformed input"){
+    std::string s1=R"({"x":1,"y":2,"z":3})";
+    yos::push_parser<Point> pp;
+    CHECK_THROWS_AS(pp.feed(s1.data(),s1.size()),yos::push_parse_error);
+    pp.reset();
+    std::string s2=R"({"x":1,"y":2])";
+    CHECK_THROWS_AS(pp.feed(s2.data(),s2.size()),yos::push_parse_error);
+    for(std::string s: {R"({"x":01,"y":2,"z":3,"id":4})",
+                        R"({"x":1,"y":2,"z":3,"id":tru})",
+                        R"({"x":1,"y":2,"z":3,"id":"4"})",
+                        R"({"x":1.,"y":2,"z":3,"id":4})",
+                        R"({"x\q":1,"y":2,"z":3,"id":4})",
+                        "{\"x\":1,\"y\":2,\"z\":3,\"i\xff\":4}",
+                        "{\"x\":1,\"y\":2,\"z\":3,\"i\td\":4}"}){
+      pp.reset();
+      CHECK_THROWS_AS(pp.feed(s.data(),s.size()),yos::push_parse_error);
+    }
+  }
+  SECTION("nested values"){
+    nlohmann::json j=tri;
+    j["pts"][1]=yos::array_json(tri.pts[1]);
+    j["pts"][2]["extra"]={{"a",{1,2,"\xc3\xa9\t"}}};
+    j["name"]="caf\xc3\xa9 \"\xf0\x9f\x98\x80\"\n";
+    std::string s=j.dump();
+    yos::push_parser<Points> pp;
+    CHECK(pp.feed(s.data(),s.size())==s.size());
+    CHECK(pp.done());
+    CHECK(pp.get().name==j["name"].get<std::string>());
+    CHECK(pp.get().pts.size()==3);
+    CHECK(pp.get().pts[1].y==tri.pts[1].y);
+    CHECK(pp.get().pts[2].id==2);
+    std::string s2=R"({"name":"caf\u00e9 \ud83d\ude00","pts":[]})";
+    yos::push_parser<Points> pp2;
+    pp2.feed(s2.data(),s2.size());
+    CHECK(pp2.get().name=="caf\xc3\xa9 \xf0\x9f\x98\x80");
+    CHECK(pp2.get().pts.empty());
+  }
+}
+
+TEST_CASE("Exception free decoding"){
+  Points tri={
+    {{0,0,0,0},{1.1,2.2,3.3,1},{-3.3,-4.4,-5.5,2}},"three points"
+  };
+  SECTION("nlohmann::json success"){
+    nlohmann::json j=tri;
+    Points tri2;
+    auto r=yos::try_from_json(j,tri2);
+    CHECK(r);
+    CHECK(r.kind==yos::errc::ok);
+    CHECK(tri.name==tri2.name);
+    CHECK(tri2.pts.size()==3);
+    CHECK(tri.pts[2].z==tri2.pts[2].z);
+  }
+  SECTION("yos::array_json success"){
+    yos::array_json j=tri;
+    Points tri2;
+    CHECK(yos::try_from_json(j,tri2));
+    CHECK(tri.name==tri2.name);
+    CHECK(tri2.pts.size()==3);
+    CHECK(tri.pts[1].id==tri2.pts[1].id);
+  }
+  SECTION("missing member"){
+    nlohmann::json j=tri;
+    j["pts"][1].erase("y");
+    Points tri2;
+    auto r=yos::try_from_json(j,tri2);
+    CHECK(!r);
+    CHECK(r.kind==yos::errc::missing_member);
+    CHECK(r.member_name()=="y");
+  }
+  SECTION("type mismatch"){
+    nlohmann::json j=tri;
+    j["name"]=3;
+    Points tri2;
+    auto r=yos::try_from_json(j,tri2);
+    CHECK(r.kind==yos::errc::type_mismatch);
+    CHECK(r.member_name()=="name");
+  }
+  SECTION("short array"){
+    yos::array_json j=tri;
+    j[0][2].erase(3);
+    Points tri2;
+    auto r=yos::try_from_json(j,tri2);
+    CHECK(r.kind==yos::errc::out_of_range);
+    CHECK(r.member_name()=="id");
+  }
+  SECTION("plain enum"){
+    Signal sig{Signal::green,3},sig2{Signal::red,0};
+    nlohmann::json j=sig;
+    CHECK(yos::try_from_json(j,sig2));
+    CHECK(sig2.state==Signal::green);
+    j["state"]="green";
+    auto r=yos::try_from_json(j,sig2);
+    CHECK(r.kind==yos::errc::type_mismatch);
+    CHECK(r.member_name()=="state");
+  }
+  SECTION("vector of bool"){
+    Flags f{{true,false,true},7};
+    nlohmann::json j=f;
+    Flags f2;
+    CHECK(yos::try_from_json(j,f2));
+    CHECK(f2.on==f.on);
+    CHECK(f2.id==7);
+    j["on"][1]=0;
+    auto r=yos::try_from_json(j,f2);
+    CHECK(r.kind==yos::errc::type_mismatch);
+    CHECK(r.member_name()=="on");
+  }
+}
+
+TEST_CASE("Pooled keys"){
+  std::vector<Point> pts={{
+      {1.1,2.2,3.3,4},
+      {10.1,20.2,30.3,5},
+      {15.1,25.2,35.3,5}}};
+  yos::key_pool::instance().seed<Point>();
+  SECTION("keys are shared"){
+    yos::pooled_map_json j=pts;
+    const std::string& k0=j[0].begin().key();
+    const std::string& k2=j[2].begin().key();
+    CHECK(k0=="id");
+    CHECK(&k0==&k2);
+    CHECK(j[1].at("y")==20.2);
+    CHECK(!j[1].contains("w"));
+  }
+  SECTION("dump and parse"){
+    yos::pooled_map_json j=pts;
+    nlohmann::json nj=pts;
+    CHECK(j.dump()==nj.dump());
+    auto j2=yos::pooled_map_json::parse(nj.dump());
+    CHECK(j2==j);
+  }
+  SECTION("roundtrip"){
+    yos::pooled_map_json j=pts;
+    std::vector<Point> pts2=j;
+    CHECK(pts2.size()==pts.size());
+    CHECK(pts[0].x ==pts2[0].x);
+    CHECK(pts[1].y ==pts2[1].y);
+    CHECK(pts[2].z ==pts2[2].z);
+    CHECK(pts[2].id==pts2[2].id);
+  }
+  SECTION("bounded pool"){
+    auto& pool=yos::key_pool::instance();
+    pool.limit(0);
+    const size_t n=pool.size();
+    std::string s="{";
+    for(int i=0;i!=1000;++i)
+      s+="\"key"+std::to_string(i)+"\":"+std::to_string(i)+",";
+    s+="\"id\":4}";
+    auto j=yos::pooled_map_json::parse(s);
+    CHECK(pool.size()==n);
+    CHECK(j.size()==1001);
+    CHECK(j.at("key999")==999);
+    CHECK(j.at("id")==4);
+    auto j2=j;
+    CHECK(j2==j);
+    CHECK(j2.dump()==nlohmann::json::parse(s).dump());
+    pool.limit(1<<20);
+  }
+}
+
+TEST_CASE("Float format"){
+  Pose p{1.23456789, -0.0004, 3.14159265, 1.1f, 7};
+  SECTION("per member format in nlohmann::json"){
+    nlohmann::json j=p;
+    CHECK(j.dump()==R"({"id":7,"theta":3.14,"v":1.1,"x":1.235,"y":0.0})");
+  }
+  SECTION("per member format in yos::array_json"){
+    yos::array_json j=p;
+    CHECK(j.dump()==R"([1.235,0.0,3.14,1.1,7])");
+  }
+  SECTION("per type format and nested struct"){
+    Poses ps{{p,p},12.345};
+    nlohmann::json j=ps;
+    CHECK(j.dump()==R"([[{"id":7,"theta":3.14,"v":1.1,"x":1.235,"y":0.0},)"
+                    R"({"id":7,"theta":3.14,"v":1.1,"x":1.235,"y":0.0}],12.3])");
+  }
+  SECTION("elements of containers"){
+    Track tr{{1.23456,-0.001,2.0/3},{0.125f,-7.777f},1.005};
+    nlohmann::json j=tr;
+    CHECK(j.dump()==R"({"origin":[0.13,-7.78],"t":1.0,"xs":[1.23,0.0,0.67]})");
+    CHECK(yos::dump(tr)==j.dump());
+  }
+  SECTION("reduced precision roundtrip"){
+    nlohmann::json j=p;
+    Pose p2=nlohmann::json::parse(j.dump());
+    CHECK(p2.x==1.235);
+    CHECK(p2.theta==3.14);
+    CHECK(p2.v==p.v);
+    CHECK(p2.id==p.id);
+  }
+}
+
+TEST_CASE("Binary form"){
+  Points tri={
+    {{0,0,0,0},{1.1,2.2,3.3,1},{-3.3,-4.4,-5.5,2}},"three points"
+  };
+  SECTION("pack and unpack"){
+    char buf[256];
+    size_t n=yos::pack(buf,sizeof(buf),tri);
+    CHECK(n==4+3*(3*8+4)+4+12);
+    Points tri2;
+    CHECK(yos::unpack(buf,n,tri2));
+    CHECK(tri.name==tri2.name);
+    CHECK(tri2.pts.size()==3);
+    CHECK(tri.pts[1].y==tri2.pts[1].y);
+    CHECK(tri.pts[2].id==tri2.pts[2].id);
+    CHECK(!yos::unpack(buf,n-1,tri2));
+    CHECK(yos::pack(buf,n-1,tri)==0);
+  }
+  SECTION("schema fingerprint"){
+    CHECK(yos::schema_fingerprint<Points>()==yos::schema_fingerprint<Points>());
+    CHECK(yos::schema_fingerprint<Points>()!=yos::schema_fingerprint<Triangle>());
+    CHECK(yos::schema_fingerprint<Point>()!=yos::schema_fingerprint<Pose>());
+    CHECK(yos::schema_fingerprint<Point>()==
+          yos::schema_fingerprint<SpacedPoint>());
+  }
+}
+
+TEST_CASE("Shared memory channel"){
+  Point pt1{1.1, 2.2, 3.3, 4};
+  auto tx=yos::shm_channel<Point>::create("/jsonutil_test",4,64);
+  auto rx=yos::shm_channel<Point>::open("/jsonutil_test");
+  SECTION("write and read"){
+    Point pt2;
+    CHECK(!rx.read(pt2));
+    CHECK(tx.write(pt1));
+    pt1.id=5;
+    CHECK(tx.write(pt1));
+    CHECK(rx.read(pt2));
+    CHECK(pt2.x==pt1.x);
+    CHECK(pt2.id==4);
+    CHECK(rx.read(pt2));
+    CHECK(pt2.id==5);
+    CHECK(!rx.read(pt2));
+    CHECK(rx.lost()==0);
+  }
+  SECTION("overwritten records"){
+    for(int i=0;i!=10;++i){
+      pt1.id=i;
+      CHECK(tx.write(pt1));
+    }
+    Point pt2;
+    std::vector<int> ids;
+    while(rx.read(pt2)) ids.push_back(pt2.id);
+    CHECK(ids==std::vector<int>({6,7,8,9}));
+    CHECK(rx.lost()==6);
+  }
+  SECTION("json view"){
+    CHECK(rx.json().is_null());
+    CHECK(tx.write(pt1));
+    nlohmann::json j=rx.json();
+    CHECK(j["id"]==4);
+    CHECK(j["z"]==3.3);
+  }
+  SECTION("schema mismatch"){
+    CHECK_THROWS(yos::shm_channel<Pose>::open("/jsonutil_test"));
+  }
+  SECTION("truncated segment"){
+    int fd=shm_open("/jsonutil_test",O_RDWR,0);
+    REQUIRE(fd>=0);
+    CHECK(ftruncate(fd,128)==0);
+    close(fd);
+    CHECK_THROWS_AS(yos::shm_channel<Point>::open("/jsonutil_test"),
+                    std::runtime_error);
+  }
+  SECTION("no slots"){
+    CHECK_THROWS_AS(yos::shm_channel<Point>::create("/jsonutil_test0",0),
+                    std::invalid_argument);
+  }
+  yos::shm_channel<Point>::remove("/jsonutil_test");
+}
+
+TEST_CASE("Snapshot"){
+  Points tri={
+    {{0,0,0,0},{1.1,2.2,3.3,1},{-3.3,-4.4,-5.5,2}},"three points"
+  };
+  const std::string path="jsonutil_test.snap";
+  yos::write_snapshot(tri,path);
+  SECTION("accessors"){
+    yos::snapshot<Points> snap(path);
+    auto root=snap.root();
+    auto pts=root[&Points::pts];
+    CHECK(pts.size()==3);
+    CHECK(pts[1][&Point::y]==2.2);
+    CHECK(pts[2][&Point::z]==-5.5);
+    CHECK(pts[2][&Point::id]==2);
+    CHECK_THROWS_AS(pts[3],std::out_of_range);
+    CHECK(root[&Points::name].str()=="three points");
+    CHECK(std::string(root[&Points::name].c_str())=="three points");
+  }
+  SECTION("load"){
+    yos::snapshot<Points> snap(path);
+    Points tri2=snap.root().load();
+    CHECK(tri.name==tri2.name);
+    CHECK(tri2.pts.size()==3);
+    for(int i=0,ec=tri2.pts.size();i!=ec;++i){
+      CHECK(tri.pts[i].x==tri2.pts[i].x);
+      CHECK(tri.pts[i].y==tri2.pts[i].y);
+      CHECK(tri.pts[i].z==tri2.pts[i].z);
+      CHECK(tri.pts[i].id==tri2.pts[i].id);
+    }
+  }
+  SECTION("nested struct"){
+    Triangle t={{0,0,0,0},{1.1,2.2,3.3,1},{-3.3,-4.4,-5.5,2},"three points"};
+    yos::write_snapshot(t,path);
+    yos::snapshot<Triangle> snap(path);
+    CHECK(snap.root()[&Triangle::p2][&Point::y]==2.2);
+    CHECK(snap.root()[&Triangle::name].size()==12);
+  }
+  SECTION("stale schema"){
+    CHECK_THROWS_AS(yos::snapshot<Triangle>(path),std::runtime_error);
+  }
+  SECTION("corrupt references"){
+    std::string bytes;
+    {
+      std::ifstream in(path,std::ios::binary);
+      bytes.assign(std::istreambuf_iterator<char>(in),{});
+    }
+    uint64_t root;
+    std::memcpy(&root,&bytes[24],8);
+    auto corrupt=[&](size_t at,int64_t v){
+      std::string b=bytes;
+      std::memcpy(&b[root+at],&v,8);
+      std::ofstream(path,std::ios::binary)<<b;
+      return yos::snapshot<Points>(path);
+    };
+    auto s1=corrupt(0,1<<30);   // pts offset
+    CHECK_THROWS_AS(s1.root()[&Points::pts],std::runtime_error);
+    CHECK_THROWS_AS(s1.root().load(),std::runtime_error);
+    auto s2=corrupt(0,-int64_t(root)-8);
+    CHECK_THROWS_AS(s2.root()[&Points::pts],std::runtime_error);
+    auto s3=corrupt(8,int64_t(1)<<60);  // pts count
+    CHECK_THROWS_AS(s3.root()[&Points::pts],std::runtime_error);
+    CHECK_THROWS_AS(s3.root().load(),std::runtime_error);
+    auto s4=corrupt(24,1000);  // name length
+    CHECK_THROWS_AS(s4.root()[&Points::name],std::runtime_error);
+    auto s5=corrupt(24,3);  // name not terminated
+    CHECK_THROWS_AS(s5.root()[&Points::name],std::runtime_error);
+    CHECK(s5.root()[&Points::pts][2][&Point::id]==2);
+  }
+  SECTION("failed write"){
+    const std::string dir="jsonutil_test.dir";
+    mkdir(dir.c_str(),0755);
+    CHECK_THROWS_AS(yos::write_snapshot(tri,dir),std::system_error);
+    CHECK(!std::ifstream(dir+".tmp"));
+    rmdir(dir.c_str());
+  }
+  std::remove(path.c_str());
+}
+
+struct Config{
+  int rate;
+  double gain;
+  bool enabled;
+  std::array<double,3> offset;
+  Point origin;
+  JSON_MEMBER(rate,gain,enabled,offset,origin);
+};
+constexpr Config default_config{100,0.25,true,{{0.1,-2.5,1e-7}},{1.5,2,-3,7}};
+struct Vec3{
+  double x,y,z;
+  JSON_MEMBER_ARRAY(x,y,z);
+};
+constexpr Vec3 unit_scale{1.5,2.25,3};
+constexpr std::array<double,13> tricky_doubles{{
+  0.1,1e300,5e-324,1.7976931348623157e308,-0.0,1e15,1e16,0.0001,0.00001,
+  2.5,-3.75,123456789012345680.0,2.2250738585072014e-308}};
+constexpr std::array<long long,4> tricky_ints{{0,-1,9223372036854775807LL,
+                                              -9223372036854775807LL-1}};
+
+TEST_CASE("Static json"){
+  using cfg=YOS_STATIC_JSON(default_config);
+  static_assert(cfg::value[0]=='{',"rendered at compile time");
+  CHECK(std::string(cfg::value)==nlohmann::json(default_config).dump());
+  CHECK(cfg::size==std::string(cfg::value).size());
+  CHECK(std::string(YOS_STATIC_JSON(tricky_doubles)::value)==
+        nlohmann::json(tricky_doubles).dump());
+  CHECK(std::string(YOS_STATIC_JSON(tricky_ints)::value)==
+        nlohmann::json(tricky_ints).dump());
+  CHECK(std::string(YOS_STATIC_JSON(unit_scale)::value)=="[1.5,2.25,3.0]");
+  CHECK(std::string(YOS_STATIC_JSON(unit_scale)::value)==
+        nlohmann::json(unit_scale).dump());
+}
+
+enum class Mode{idle,run,stop};
+JSON_ENUM(Mode,idle,run,stop);
+namespace color{
+enum Color{red,orange,yellow,green,blue,indigo,violet,black,white,gray,
+           cyan,magenta,brown,pink,olive,navy,teal,maroon,lime,aqua,
+           silver,gold,beige,coral,ivory,khaki,lavender,plum,salmon,tan};
+JSON_ENUM(Color,red,orange,yellow,green,blue,indigo,violet,black,white,gray,
+          cyan,magenta,brown,pink,olive,navy,teal,maroon,lime,aqua,
+          silver,gold,beige,coral,ivory,khaki,lavender,plum,salmon,tan);
+}
+struct Lamp{
+  Mode mode;
+  color::Color color;
+  int id;
+  JSON_MEMBER(mode,color,id);
+};
+constexpr Lamp default_lamp{Mode::run,color::teal,3};
+
+TEST_CASE("Enum names"){
+  SECTION("to/from json"){
+    nlohmann::json j=Mode::stop;
+    CHECK(j=="stop");
+    CHECK(nlohmann::json("run").get<Mode>()==Mode::run);
+    for(int i=0;i<=color::tan;++i){
+      const auto c=static_cast<color::Color>(i);
+      CHECK(nlohmann::json(c).is_string());
+      CHECK(nlohmann::json(c).get<color::Color>()==c);
+    }
+  }
+  SECTION("member"){
+    Lamp l{Mode::idle,color::violet,1};
+    nlohmann::json j=l;
+    CHECK(j["mode"]=="idle");
+    CHECK(j["color"]=="violet");
+    yos::array_json ja=l;
+    CHECK(ja.dump()==R"(["idle","violet",1])");
+    yos::map_json jm=l;
+    CHECK(jm["color"]=="violet");
+    Lamp l2=nlohmann::json::parse(R"({"mode":"stop","color":"tan","id":2})");
+    CHECK(l2.mode==Mode::stop);
+    CHECK(l2.color==color::tan);
+    Lamp l3=ja.get<Lamp>();
+    CHECK(l3.color==color::violet);
+    std::vector<Mode> v=nlohmann::json::parse(R"(["run","idle"])");
+    CHECK(v==std::vector<Mode>{Mode::run,Mode::idle});
+  }
+  SECTION("errors"){
+    using out_of_range=nlohmann::json::out_of_range;
+    CHECK_THROWS_AS(nlohmann::json("walk").get<Mode>(),out_of_range);
+    CHECK_THROWS_AS(nlohmann::json("").get<Mode>(),out_of_range);
+    CHECK_THROWS_AS(nlohmann::json("runs").get<Mode>(),out_of_range);
+    CHECK_THROWS_AS(nlohmann::json(1).get<Mode>(),nlohmann::json::type_error);
+    CHECK_THROWS_AS(nlohmann::json(static_cast<Mode>(7)),out_of_range);
+    Lamp l;
+    auto r=yos::try_from_json(
+      nlohmann::json::parse(R"({"mode":"walk","color":"tan","id":2})"),l);
+    CHECK(r.kind==yos::errc::unknown_name);
+    CHECK(r.member_name()=="mode");
+    r=yos::try_from_json(
+      nlohmann::json::parse(R"({"mode":"run","color":"tan","id":2})"),l);
+    CHECK(r);
+    CHECK(l.color==color::tan);
+  }
+  SECTION("static json"){
+    CHECK(std::string(YOS_STATIC_JSON(default_lamp)::value)==
+          nlohmann::json(default_lamp).dump());
+  }
+}
+
+TEST_CASE("Parallel parse"){
+  Points pts;
+  pts.name="many \"points\" [,]";
+  for(int i=0;i!=50000;++i)
+    pts.pts.push_back(Point{i*0.5,-i*0.25,1e-3*i,i});
+  auto check=[&](const Points& p){
+    REQUIRE(p.pts.size()==pts.pts.size());
+    CHECK(p.name==pts.name);
+    for(size_t i=0;i!=p.pts.size();++i){
+      if(p.pts[i].x!=pts.pts[i].x || p.pts[i].y!=pts.pts[i].y ||
+         p.pts[i].z!=pts.pts[i].z || p.pts[i].id!=pts.pts[i].id)
+        FAIL("element "<<i);
+    }
+  };
+  SECTION("object form"){
+    const std::string s=nlohmann::json(pts).dump();
+    REQUIRE(s.size()>yos::parallel_min_bytes);
+    check(yos::parallel_parse<Points>(s.data(),s.size(),4));
+    check(yos::parallel_parse<Points>(s.data(),s.size(),1));
+  }
+  SECTION("array form"){
+    const std::string s=yos::array_json(pts).dump(2);
+    check(yos::parallel_parse<Points>(s.data(),s.size(),3));
+  }
+  SECTION("strings with escapes"){
+    std::vector<Triangle> v;
+    for(int i=0;i!=20000;++i){
+      v.push_back(Triangle{{0,0,0,i},{1,2,3,i},{4,5,6,i},
+        std::string(i%7,'\\')+"\"],{"+std::to_string(i)+std::string(i%3,'"')});
+    }
+    const std::string s=nlohmann::json(v).dump();
+    REQUIRE(s.size()>yos::parallel_min_bytes);
+    auto v2=yos::parallel_parse<std::vector<Triangle>>(s.data(),s.size(),4);
+    REQUIRE(v2.size()==v.size());
+    for(size_t i=0;i!=v.size();++i){
+      if(v2[i].name!=v[i].name || v2[i].p3.id!=v[i].p3.id) FAIL("element "<<i);
+    }
+  }
+  SECTION("errors"){
+    std::string s=nlohmann::json(pts).dump();
+    std::string broken=s;
+    broken.insert(s.find("\"x\":",s.size()/2)+4,":");
+    CHECK_THROWS_AS(yos::parallel_parse<Points>(broken.data(),broken.size(),4),
+                    nlohmann::json::parse_error);
+    const std::string missing="{"+s.substr(s.find("\"pts\""));
+    CHECK_THROWS_AS(yos::parallel_parse<Points>(missing.data(),missing.size(),4),
+                    nlohmann::json::out_of_range);
+    for(std::string bad: {R"({"x":1,"y":2,"z":3,"id":4,"junk":@@@})",
+                          R"([1,2,3,4,nope])"}){
+      CHECK_THROWS_AS(yos::parallel_parse<Point>(bad.data(),bad.size(),4),
+                      nlohmann::json::parse_error);
+    }
+    const std::string badkey="{\"x\":1,\"y\":2,\"z\":3,\"id\":4,\"\xc3\":0}";
+    CHECK_THROWS_AS(yos::parallel_parse<Point>(badkey.data(),badkey.size(),4),
+                    nlohmann::json::parse_error);
+    const std::string extra=R"({"x":1,"y":2,"z":3,"id":4,"w":[{}]})";
+    CHECK(yos::parallel_parse<Point>(extra.data(),extra.size(),4).id==4);
+  }
+}
+
+struct LogRecord{
+  double t;
+  float load;
+  int level;
+  unsigned long long seq;
+  bool ok;
+  Mode mode;
+  std::string host,message;
+  std::vector<std::string> tags;
+  std::array<Point,2> box;
+  JSON_MEMBER(t,load,level,seq,ok,mode,host,message,tags,box);
+};
+
+TEST_CASE("String kernels"){
+  const yos::simd levels[]={yos::simd::scalar,yos::simd::sse2,yos::simd::avx2};
+  std::string s;
+  for(int i=0;i!=300;++i) s+=static_cast<char>(i%128);
+  s+=u8"éあ\U0001F600 end";
+  for(auto l:levels){
+    const auto& k=yos::string_kernels::get(l);
+    for(size_t b=0;b!=s.size();++b){
+      size_t e=b;
+      while(e!=s.size() && !(static_cast<unsigned char>(s[e])<0x20 ||
+                             s[e]=='"' || s[e]=='\\')) ++e;
+      if(k.escape_scan(s.data()+b,s.size()-b)!=e-b) FAIL("escape_scan "<<b);
+      std::string d(s.size(),'\0');
+      if(k.copy_clean(&d[0],s.data()+b,s.size()-b)!=e-b ||
+         d.compare(0,e-b,s,b,e-b)!=0) FAIL("copy_clean "<<b);
+    }
+    std::string out;
+    yos::append_escaped(out,s.data(),s.size(),k);
+    CHECK(out==nlohmann::json(s).dump());
+    CHECK(k.validate_utf8(s.data(),s.size()));
+    const char* bad[]={"\xc0\xaf","\xe0\x80\xaf","\xed\xa0\x80","\xf4\x90\x80\x80",
+                       "\xf8\x88\x80\x80\x80","\xe3\x81","\x80","\xff"};
+    for(auto b:bad){
+      const std::string t=std::string(40,'a')+b+std::string(40,'a');
+      CHECK_FALSE(k.validate_utf8(t.data(),t.size()));
+      CHECK_FALSE(k.validate_utf8(b,std::strlen(b)));
+    }
+  }
+}
+
+TEST_CASE("Direct dump"){
+  LogRecord r{1.5e9,0.1f,3,18446744073709551615ull,true,Mode::run,"host-01",
+              "GET /index.html \"quoted\" \\ tab\t nl\n \x01 caf\xc3\xa9",
+              {"a","b\"c"},{{{0,0,0,0},{1.25,-2,3e-8,-7}}}};
+  CHECK(yos::dump(r)==nlohmann::json(r).dump());
+  Pose p{1.23456,-2.5,3.14159265,0.1f,7};
+  CHECK(yos::dump(p)==nlohmann::json(p).dump());
+  Poses ps{{p,p},123.456};
+  CHECK(yos::dump(ps)==nlohmann::json(ps).dump());
+  Lamp l{Mode::stop,color::navy,-4};
+  CHECK(yos::dump(l)==nlohmann::json(l).dump());
+  std::vector<double> d{0.1,-0.0,1e300,std::nan(""),5e-324};
+  CHECK(yos::dump(d)==nlohmann::json(d).dump());
+  r.message="bad \xff utf8";
+  CHECK_THROWS_AS(yos::dump(r),nlohmann::json::type_error);
+}
+
+// no default constructor
+struct Id{
+  explicit Id(int v):v(v){}
+  int v;
+};
+namespace nlohmann{
+template<>
+struct adl_serializer<Id>{
+  static Id from_json(const json& j){ return Id(j.get<int>()); }
+  static void to_json(json& j, const Id& id){ j=id.v; }
+};
+}
+struct Tagged{
+  std::vector<Id> ids;
+  int n;
+  JSON_MEMBER(ids,n);
+};
+
+TEST_CASE("Positional decode"){
+  SECTION("nested arrays"){
+    Points pts{{{0,0,0,0},{1.1,2.2,3.3,1},{-3.3,-4.4,-5.5,2}},"three"};
+    yos::array_json j=pts;
+    Points p=j.get<Points>();
+    REQUIRE(p.pts.size()==3);
+    CHECK(p.pts[2].z==-5.5);
+    CHECK(p.pts[1].id==1);
+    CHECK(p.name=="three");
+  }
+  SECTION("mixed json types"){
+    // integers into doubles, objects inside arrays, extra elements
+    auto j=nlohmann::json::parse(
+      R"([[[1,2,3,4],{"x":5,"y":6,"z":7.5,"id":8}],"mixed",null])");
+    Points p=j.get<Points>();
+    REQUIRE(p.pts.size()==2);
+    CHECK(p.pts[0].x==1.0);
+    CHECK(p.pts[1].z==7.5);
+    CHECK(p.pts[1].id==8);
+    Config c=nlohmann::json::parse(R"([7,1,false,[1,2.5,3],[1,2,3,4]])");
+    CHECK(c.rate==7);
+    CHECK(c.gain==1.0);
+    CHECK(c.offset[1]==2.5);
+    CHECK(c.origin.id==4);
+    Lamp l=nlohmann::json::parse(R"(["run","gold",3])");
+    CHECK(l.mode==Mode::run);
+    CHECK(l.color==color::gold);
+  }
+  SECTION("element without default constructor"){
+    Tagged t=nlohmann::json::parse(R"([[3,1,4],3])");
+    REQUIRE(t.ids.size()==3);
+    CHECK(t.ids[2].v==4);
+    CHECK(t.n==3);
+    nlohmann::json j=t;
+    CHECK(j.dump()==R"({"ids":[3,1,4],"n":3})");
+  }
+  SECTION("errors"){
+    const auto short_array=nlohmann::json::parse("[1,2]");
+    try{
+      short_array.get<Point>();
+      FAIL("no exception");
+    }catch(nlohmann::json::out_of_range& e){
+      CHECK(std::string(e.what()).find("array index 2")!=std::string::npos);
+    }
+    CHECK_THROWS_AS(nlohmann::json::parse(R"([1,2,"3",4])").get<Point>(),
+                    nlohmann::json::type_error);
+    CHECK_THROWS_AS(nlohmann::json::parse(R"([[[1,2,3]],"n"])").get<Points>(),
+                    nlohmann::json::out_of_range);
+    CHECK_THROWS_AS(nlohmann::json::parse(R"(["walk","gold",3])").get<Lamp>(),
+                    nlohmann::json::out_of_range);
+  }
+}